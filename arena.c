@@ -0,0 +1,164 @@
+#include "./arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Size of the first block, big enough for the words of most command lines
+#define ARENA_BLOCK_SIZE 16384
+
+// used is how much of data has been handed out, including the open string
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+typedef struct arena_block arena_block_t;
+
+// current is the block holding the string being built, which starts at
+// start and runs up to current->used
+struct arena {
+    arena_block_t *head;
+    arena_block_t *current;
+    size_t start;
+};
+
+/* allocates an empty block able to hold size characters */
+static arena_block_t *new_block(size_t size) {
+    arena_block_t *block =
+        (arena_block_t *)malloc(sizeof(arena_block_t) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/* initializes an empty arena, returns pointer */
+arena_t *init_arena() {
+    arena_t *arena = (arena_t *)malloc(sizeof(arena_t));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->head = new_block(ARENA_BLOCK_SIZE);
+    if (arena->head == NULL) {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->head;
+    arena->start = 0;
+    return arena;
+}
+
+/*
+ * cleans up the arena
+ * Note: this function will free the arena pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_arena(arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+    arena_block_t *cur = arena->head;
+    while (cur != NULL) {
+        arena_block_t *next = cur->next;
+        free(cur);
+        cur = next;
+    }
+    free(arena);
+}
+
+/* frees every string in the arena, keeping its first block for reuse */
+void reset_arena(arena_t *arena) {
+    arena_block_t *cur = arena->head->next;
+    while (cur != NULL) {
+        arena_block_t *next = cur->next;
+        free(cur);
+        cur = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+    arena->current = arena->head;
+    arena->start = 0;
+}
+
+/*
+ * gets space for at least min more characters at the end of the string being
+ * built, so they can be written there directly, stores how many characters
+ * fit in available, returns NULL on failure
+ */
+char *arena_reserve(arena_t *arena, size_t min, size_t *available) {
+    arena_block_t *block = arena->current;
+    // One character is always kept free for the terminating NUL
+    if (block->size - block->used < min + 1) {
+        size_t length = block->used - arena->start;
+        size_t size = 2 * block->size;
+        if (size < length + min + 1) {
+            size = length + min + 1;
+        }
+        arena_block_t *grown = new_block(size);
+        if (grown == NULL) {
+            return NULL;
+        }
+        // Only the unfinished string moves, the block it leaves keeps the
+        // finished ones
+        memcpy(grown->data, block->data + arena->start, length);
+        block->used = arena->start;
+        grown->used = length;
+        grown->next = block->next;
+        block->next = grown;
+        arena->current = grown;
+        arena->start = 0;
+        block = grown;
+    }
+    *available = block->size - block->used - 1;
+    return block->data + block->used;
+}
+
+/* adds count characters written into reserved space to the string */
+void arena_commit(arena_t *arena, size_t count) {
+    arena->current->used += count;
+}
+
+/* appends count characters to the string being built, returns 0 on success,
+ * -1 on failure */
+int arena_append(arena_t *arena, const char *src, size_t count) {
+    size_t available;
+    char *space = arena_reserve(arena, count, &available);
+    if (space == NULL) {
+        return -1;
+    }
+    memcpy(space, src, count);
+    arena_commit(arena, count);
+    return 0;
+}
+
+/* gets the string being built, which is not NUL terminated, and its length */
+char *arena_current(arena_t *arena, size_t *length) {
+    *length = arena->current->used - arena->start;
+    return arena->current->data + arena->start;
+}
+
+/* shortens the string being built to length characters */
+void arena_truncate(arena_t *arena, size_t length) {
+    if (length < arena->current->used - arena->start) {
+        arena->current->used = arena->start + length;
+    }
+}
+
+/*
+ * NUL terminates the string being built and starts a new one,
+ * returns the finished string, or NULL on failure
+ */
+char *arena_finish(arena_t *arena) {
+    size_t available;
+    if (arena_reserve(arena, 0, &available) == NULL) {
+        return NULL;
+    }
+    char *string = arena->current->data + arena->start;
+    arena->current->data[arena->current->used] = '\0';
+    arena->current->used++;
+    arena->start = arena->current->used;
+    return string;
+}
@@ -0,0 +1,46 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+/*
+ * An arena hands out strings that all stay valid until the arena is reset.
+ * One string at a time is built at the end of the arena, and it is moved to a
+ * larger block when it outgrows its current one, so nothing already finished
+ * is ever moved.
+ */
+typedef struct arena arena_t;
+
+/* initializes an empty arena, returns pointer */
+arena_t *init_arena();
+/*
+ * cleans up the arena
+ * Note: this function will free the arena pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_arena(arena_t *arena);
+/* frees every string in the arena, keeping its first block for reuse */
+void reset_arena(arena_t *arena);
+
+/* appends count characters to the string being built, returns 0 on success,
+ * -1 on failure */
+int arena_append(arena_t *arena, const char *src, size_t count);
+/*
+ * gets space for at least min more characters at the end of the string being
+ * built, so they can be written there directly, stores how many characters
+ * fit in available, returns NULL on failure
+ */
+char *arena_reserve(arena_t *arena, size_t min, size_t *available);
+/* adds count characters written into reserved space to the string */
+void arena_commit(arena_t *arena, size_t count);
+/* gets the string being built, which is not NUL terminated, and its length */
+char *arena_current(arena_t *arena, size_t *length);
+/* shortens the string being built to length characters */
+void arena_truncate(arena_t *arena, size_t length);
+/*
+ * NUL terminates the string being built and starts a new one,
+ * returns the finished string, or NULL on failure
+ */
+char *arena_finish(arena_t *arena);
+
+#endif  // ARENA_H_
@@ -0,0 +1,403 @@
+#include "./arith.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// cursor walks over the expression, which ends at end rather than at a NUL
+// error is set once a problem has been reported so evaluation unwinds quietly
+// skip is set while parsing an operand whose value is not used, such as the
+// right side of a false &&, which is then parsed but not evaluated
+typedef struct arith_state {
+    var_table_t *var_table;
+    const char *cursor;
+    const char *end;
+    int error;
+    int skip;
+} arith_state_t;
+
+static long parse_ternary(arith_state_t *state);
+
+/* reports an error once and marks the evaluation as failed */
+static long arith_error(arith_state_t *state, const char *msg) {
+    if (!state->error) {
+        fprintf(stderr, "arithmetic: %s\n", msg);
+        state->error = 1;
+    }
+    return 0;
+}
+
+/* skips whitespace before the next token */
+static void skip_space(arith_state_t *state) {
+    while (state->cursor < state->end &&
+           (*state->cursor == ' ' || *state->cursor == '\t' ||
+            *state->cursor == '\n')) {
+        state->cursor++;
+    }
+}
+
+/*
+ * consumes the operator op if it is the next token and is not the start of a
+ * longer operator listed in unless, returns 1 if it was consumed
+ */
+static int accept(arith_state_t *state, const char *op, const char *unless) {
+    skip_space(state);
+    size_t length = strlen(op);
+    if ((size_t)(state->end - state->cursor) < length ||
+        strncmp(state->cursor, op, length) != 0) {
+        return 0;
+    }
+    if (unless != NULL && state->cursor + length < state->end &&
+        strchr(unless, state->cursor[length]) != NULL) {
+        return 0;
+    }
+    state->cursor += length;
+    return 1;
+}
+
+/*
+ * adds, subtracts and multiplies in unsigned arithmetic, so that overflow
+ * wraps around as in other shells instead of being undefined
+ */
+static long wrap_add(long left, long right) {
+    return (long)((unsigned long)left + (unsigned long)right);
+}
+
+static long wrap_sub(long left, long right) {
+    return (long)((unsigned long)left - (unsigned long)right);
+}
+
+static long wrap_mul(long left, long right) {
+    return (long)((unsigned long)left * (unsigned long)right);
+}
+
+/*
+ * divides or takes the remainder for op '/' or '%', with LONG_MIN / -1
+ * wrapping around rather than trapping, returns 0 with an error on a zero
+ * divisor
+ */
+static long divide(arith_state_t *state, char op, long value, long divisor) {
+    if (divisor == 0) {
+        return arith_error(state, "division by zero");
+    }
+    if (divisor == -1) {
+        return op == '/' ? wrap_sub(0, value) : 0;
+    }
+    return op == '/' ? value / divisor : value % divisor;
+}
+
+/*
+ * shifts left or right by the count taken modulo the width of a long, as the
+ * processor does, a left shift is done unsigned so that it may overflow
+ */
+static long shift(char op, long value, long count) {
+    int bits = (int)(count & (long)(sizeof(long) * CHAR_BIT - 1));
+    if (op == '<') {
+        return (long)((unsigned long)value << bits);
+    }
+    return value >> bits;
+}
+
+/* looks up a variable, unset or empty variables count as 0 */
+static long read_var(arith_state_t *state, const char *name) {
+    if (state->skip) {
+        return 0;
+    }
+    char *value = get_var(state->var_table, name);
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+    char *value_end;
+    long number = strtol(value, &value_end, 0);
+    if (*value_end != '\0') {
+        return arith_error(state, "variable is not a number");
+    }
+    return number;
+}
+
+/* applies a compound assignment operator such as += to a variable */
+static long assign(arith_state_t *state, const char *name, char op,
+                   long value) {
+    if (state->skip) {
+        return 0;
+    }
+    long current = op == '=' ? 0 : read_var(state, name);
+    switch (op) {
+        case '+':
+            value = wrap_add(current, value);
+            break;
+        case '-':
+            value = wrap_sub(current, value);
+            break;
+        case '*':
+            value = wrap_mul(current, value);
+            break;
+        case '/':
+        case '%':
+            value = divide(state, op, current, value);
+            break;
+        default:
+            break;
+    }
+    char number[32];
+    snprintf(number, sizeof(number), "%ld", value);
+    if (!state->error && set_var(state->var_table, name, number, 0) == -1) {
+        return arith_error(state, "assignment failed");
+    }
+    return value;
+}
+
+/* parses a number, a variable, an assignment or a parenthesized expression */
+static long parse_primary(arith_state_t *state) {
+    skip_space(state);
+    if (state->cursor >= state->end) {
+        return arith_error(state, "expression expected");
+    }
+    if (accept(state, "(", NULL)) {
+        long value = parse_ternary(state);
+        if (!accept(state, ")", NULL)) {
+            return arith_error(state, "missing ')'");
+        }
+        return value;
+    }
+    if (*state->cursor >= '0' && *state->cursor <= '9') {
+        char digits[32];
+        size_t length = 0;
+        while (state->cursor + length < state->end && length + 1 < sizeof(digits) &&
+               ((state->cursor[length] >= '0' && state->cursor[length] <= '9') ||
+                (state->cursor[length] >= 'a' && state->cursor[length] <= 'f') ||
+                (state->cursor[length] >= 'A' && state->cursor[length] <= 'F') ||
+                state->cursor[length] == 'x' || state->cursor[length] == 'X')) {
+            digits[length] = state->cursor[length];
+            length++;
+        }
+        digits[length] = '\0';
+        char *digits_end;
+        long value = strtol(digits, &digits_end, 0);
+        if (*digits_end != '\0') {
+            return arith_error(state, "invalid number");
+        }
+        state->cursor += length;
+        return value;
+    }
+    // Variables may be written with or without the leading '$'
+    const char *name_start = state->cursor + (*state->cursor == '$');
+    char name[256];
+    size_t length = 0;
+    while (name_start + length < state->end && length + 1 < sizeof(name) &&
+           (name_start[length] == '_' ||
+            (name_start[length] >= 'a' && name_start[length] <= 'z') ||
+            (name_start[length] >= 'A' && name_start[length] <= 'Z') ||
+            (length > 0 && name_start[length] >= '0' &&
+             name_start[length] <= '9'))) {
+        name[length] = name_start[length];
+        length++;
+    }
+    name[length] = '\0';
+    if (length == 0) {
+        return arith_error(state, "syntax error");
+    }
+    state->cursor = name_start + length;
+
+    const char *ops[] = {"+=", "-=", "*=", "/=", "%="};
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (accept(state, ops[i], NULL)) {
+            return assign(state, name, ops[i][0], parse_ternary(state));
+        }
+    }
+    if (accept(state, "=", "=")) {
+        return assign(state, name, '=', parse_ternary(state));
+    }
+    return read_var(state, name);
+}
+
+/* parses the unary operators + - ! ~ */
+static long parse_unary(arith_state_t *state) {
+    if (accept(state, "-", "=")) {
+        return wrap_sub(0, parse_unary(state));
+    } else if (accept(state, "+", "=")) {
+        return parse_unary(state);
+    } else if (accept(state, "!", "=")) {
+        return !parse_unary(state);
+    } else if (accept(state, "~", NULL)) {
+        return ~parse_unary(state);
+    }
+    return parse_primary(state);
+}
+
+/* parses * / % */
+static long parse_multiplicative(arith_state_t *state) {
+    long value = parse_unary(state);
+    while (!state->error) {
+        if (accept(state, "*", "=")) {
+            value = wrap_mul(value, parse_unary(state));
+        } else if (accept(state, "/", "=") || accept(state, "%", "=")) {
+            char op = state->cursor[-1];
+            long divisor = parse_unary(state);
+            if (!state->skip) {
+                value = divide(state, op, value, divisor);
+            }
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+/* parses + - */
+static long parse_additive(arith_state_t *state) {
+    long value = parse_multiplicative(state);
+    while (!state->error) {
+        if (accept(state, "+", "=")) {
+            value = wrap_add(value, parse_multiplicative(state));
+        } else if (accept(state, "-", "=")) {
+            value = wrap_sub(value, parse_multiplicative(state));
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+/* parses << >> */
+static long parse_shift(arith_state_t *state) {
+    long value = parse_additive(state);
+    while (!state->error) {
+        if (accept(state, "<<", NULL)) {
+            value = shift('<', value, parse_additive(state));
+        } else if (accept(state, ">>", NULL)) {
+            value = shift('>', value, parse_additive(state));
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+/* parses < <= > >= */
+static long parse_relational(arith_state_t *state) {
+    long value = parse_shift(state);
+    while (!state->error) {
+        if (accept(state, "<=", NULL)) {
+            value = value <= parse_shift(state);
+        } else if (accept(state, ">=", NULL)) {
+            value = value >= parse_shift(state);
+        } else if (accept(state, "<", "<")) {
+            value = value < parse_shift(state);
+        } else if (accept(state, ">", ">")) {
+            value = value > parse_shift(state);
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+/* parses == != */
+static long parse_equality(arith_state_t *state) {
+    long value = parse_relational(state);
+    while (!state->error) {
+        if (accept(state, "==", NULL)) {
+            value = value == parse_relational(state);
+        } else if (accept(state, "!=", NULL)) {
+            value = value != parse_relational(state);
+        } else {
+            break;
+        }
+    }
+    return value;
+}
+
+/* parses the bitwise operators & ^ | in order of precedence */
+static long parse_bit_and(arith_state_t *state) {
+    long value = parse_equality(state);
+    while (!state->error && accept(state, "&", "&=")) {
+        value &= parse_equality(state);
+    }
+    return value;
+}
+
+static long parse_bit_xor(arith_state_t *state) {
+    long value = parse_bit_and(state);
+    while (!state->error && accept(state, "^", "=")) {
+        value ^= parse_bit_and(state);
+    }
+    return value;
+}
+
+static long parse_bit_or(arith_state_t *state) {
+    long value = parse_bit_xor(state);
+    while (!state->error && accept(state, "|", "|=")) {
+        value |= parse_bit_xor(state);
+    }
+    return value;
+}
+
+/*
+ * parses && and ||, the right side is only evaluated when the left side does
+ * not already decide the result
+ */
+static long parse_logical_and(arith_state_t *state) {
+    long value = parse_bit_or(state);
+    while (!state->error && accept(state, "&&", NULL)) {
+        int skip = state->skip;
+        state->skip = skip || !value;
+        long right = parse_bit_or(state);
+        state->skip = skip;
+        value = value && right;
+    }
+    return value;
+}
+
+static long parse_logical_or(arith_state_t *state) {
+    long value = parse_logical_and(state);
+    while (!state->error && accept(state, "||", NULL)) {
+        int skip = state->skip;
+        state->skip = skip || value;
+        long right = parse_logical_and(state);
+        state->skip = skip;
+        value = value || right;
+    }
+    return value;
+}
+
+/* parses the conditional operator ?:, evaluating only the branch taken */
+static long parse_ternary(arith_state_t *state) {
+    long condition = parse_logical_or(state);
+    if (state->error || !accept(state, "?", NULL)) {
+        return condition;
+    }
+    int skip = state->skip;
+    state->skip = skip || !condition;
+    long if_true = parse_ternary(state);
+    state->skip = skip;
+    if (!accept(state, ":", NULL)) {
+        return arith_error(state, "missing ':'");
+    }
+    state->skip = skip || condition;
+    long if_false = parse_ternary(state);
+    state->skip = skip;
+    return condition ? if_true : if_false;
+}
+
+/*
+ * evaluates the arithmetic expression in the first length characters of
+ * expression, as found between the parentheses of $(( )), and stores its value
+ * in result. Variables may be named with or without a leading '$' and can be
+ * assigned with =, +=, -=, *=, /= and %=.
+ * returns 0 on success, -1 on a syntax error or division by zero
+ */
+int arith_eval(var_table_t *var_table, const char *expression, size_t length,
+               long *result) {
+    arith_state_t state = {var_table, expression, expression + length, 0, 0};
+    long value = parse_ternary(&state);
+    skip_space(&state);
+    if (!state.error && state.cursor != state.end) {
+        arith_error(&state, "syntax error");
+    }
+    if (state.error) {
+        return -1;
+    }
+    *result = value;
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef ARITH_H_
+#define ARITH_H_
+
+#include <stddef.h>
+#include "./vars.h"
+
+/*
+ * evaluates the arithmetic expression in the first length characters of
+ * expression, as found between the parentheses of $(( )), and stores its value
+ * in result. Variables may be named with or without a leading '$' and can be
+ * assigned with =, +=, -=, *=, /= and %=.
+ * returns 0 on success, -1 on a syntax error or division by zero
+ */
+int arith_eval(var_table_t *var_table, const char *expression, size_t length,
+               long *result);
+
+#endif  // ARITH_H_
@@ -0,0 +1,456 @@
+#include "./builtins.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "./copy.h"
+
+// Each builtin along with the option letters it handles itself, or NULL if it
+// reads its own options and takes any argument
+typedef struct builtin_entry {
+    const char *name;
+    builtin_t run;
+    const char *options;
+} builtin_entry_t;
+
+static const builtin_entry_t builtins[] = {
+    {"cat", cat_builtin, ""},        {"echo", echo_builtin, NULL},
+    {"printf", printf_builtin, NULL}, {"true", true_builtin, NULL},
+    {"false", false_builtin, NULL},  {"pwd", pwd_builtin, ""},
+    {"mkdir", mkdir_builtin, "p"},   {"rmdir", rmdir_builtin, ""},
+    {"mv", mv_builtin, "f"}};
+
+/* returns 1 if arg is an option rather than an operand */
+static int is_option(const char *arg) {
+    return arg[0] == '-' && arg[1] != '\0';
+}
+
+/*
+ * finds the builtin standing in for the command name, which is one of cat,
+ * echo, printf, true, false, pwd, mkdir, rmdir and mv, returns NULL if there
+ * is none or the arguments use options it does not handle, in which case the
+ * external command should be run instead
+ */
+builtin_t find_builtin(const char *name, char *argv[], int argc) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (strcmp(name, builtins[i].name) != 0) {
+            continue;
+        }
+        const char *options = builtins[i].options;
+        for (int arg = 1; options != NULL && arg < argc; arg++) {
+            // Options are accepted anywhere, and -- is left to the command
+            if (is_option(argv[arg]) &&
+                (strcmp(argv[arg], "--") == 0 ||
+                 strspn(argv[arg] + 1, options) != strlen(argv[arg] + 1))) {
+                return NULL;
+            }
+        }
+        return builtins[i].run;
+    }
+    return NULL;
+}
+
+/*
+ * cat, copies each file, or standard input for - or when no file is given, to
+ * standard output with copy_fd, so the data never passes through the shell
+ */
+int cat_builtin(char *argv[], int argc) {
+    int status = 0;
+    // A reader that goes away must not take the shell down with it
+    void (*previous)(int) = signal(SIGPIPE, SIG_IGN);
+    for (int i = argc > 1 ? 1 : 0; i < argc; i++) {
+        int from_stdin = i == 0 || strcmp(argv[i], "-") == 0;
+        int fd = from_stdin ? 0 : open(argv[i], O_RDONLY | O_CLOEXEC);
+        int result = fd == -1 ? -1 : copy_fd(fd, 1);
+        int error = errno;
+        if (fd != -1 && !from_stdin) {
+            close(fd);
+        }
+        // Like the external cat, stop quietly once nobody is reading
+        if (result == -1 && error == EPIPE) {
+            status = 128 + SIGPIPE;
+            break;
+        } else if (result == -1) {
+            fprintf(stderr, "cat: %s: %s\n", from_stdin ? "-" : argv[i],
+                    strerror(error));
+            status = 1;
+        }
+    }
+    signal(SIGPIPE, previous);
+    return status;
+}
+
+/*
+ * prints the character of the escape sequence that follows a backslash at
+ * text, setting stop for \c, returns the number of characters it used. Octal
+ * values take up to three digits, which with zero_octal have to follow a 0,
+ * as echo and %b write them.
+ */
+static size_t print_escape(const char *text, int zero_octal, int *stop) {
+    const char *from = "abefnrtv\\";
+    const char *to = "\a\b\033\f\n\r\t\v\\";
+    const char *found = *text != '\0' ? strchr(from, *text) : NULL;
+    if (found != NULL) {
+        putchar(to[found - from]);
+        return 1;
+    } else if (*text == 'c') {
+        *stop = 1;
+        return 1;
+    }
+    // Characters before the digits, and how the digits are read
+    size_t skip;
+    int base;
+    size_t max_digits;
+    if (*text == 'x') {
+        skip = 1;
+        base = 16;
+        max_digits = 2;
+    } else if (zero_octal ? *text == '0' : (*text >= '0' && *text <= '7')) {
+        skip = (size_t)zero_octal;
+        base = 8;
+        max_digits = 3;
+    } else {
+        // Not an escape, the backslash is printed as it is
+        putchar('\\');
+        return 0;
+    }
+    int value = 0;
+    size_t digits = 0;
+    while (digits < max_digits) {
+        char c = text[skip + digits];
+        int digit = c >= '0' && c <= '9'   ? c - '0'
+                    : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                    : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                           : base;
+        if (digit >= base) {
+            break;
+        }
+        value = value * base + digit;
+        digits++;
+    }
+    if (base == 16 && digits == 0) {
+        putchar('\\');
+        return 0;
+    }
+    putchar(value);
+    return skip + digits;
+}
+
+/* prints text, interpreting its escape sequences, returns 1 if \c was seen */
+static int print_escaped(const char *text, int zero_octal) {
+    int stop = 0;
+    while (*text != '\0' && !stop) {
+        if (*text == '\\') {
+            text++;
+            text += print_escape(text, zero_octal, &stop);
+        } else {
+            putchar(*text++);
+        }
+    }
+    return stop;
+}
+
+/* echo [-neE] args, prints the arguments separated by spaces */
+int echo_builtin(char *argv[], int argc) {
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+    // Only arguments made up entirely of known option letters are options
+    for (; i < argc && is_option(argv[i]) &&
+           strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1);
+         i++) {
+        for (char *option = argv[i] + 1; *option != '\0'; option++) {
+            if (*option == 'n') {
+                newline = 0;
+            } else {
+                escapes = *option == 'e';
+            }
+        }
+    }
+    for (; i < argc; i++) {
+        // \c ends the output, without a newline
+        if (escapes && print_escaped(argv[i], 1)) {
+            return 0;
+        } else if (!escapes) {
+            fputs(argv[i], stdout);
+        }
+        if (i + 1 < argc) {
+            putchar(' ');
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+/*
+ * converts a printf argument to a number, which may be written in octal or
+ * hex or as a quote followed by a character, reporting it if it is invalid
+ */
+static long printf_number(const char *arg, int *status) {
+    if (arg == NULL) {
+        return 0;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        return (unsigned char)arg[1];
+    }
+    char *end;
+    errno = 0;
+    long value = strtol(arg, &end, 0);
+    if (*arg == '\0' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+/*
+ * printf format args, prints the arguments as described by format, which is
+ * reused for as long as arguments are left
+ */
+int printf_builtin(char *argv[], int argc) {
+    if (argc < 2) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    const char *format = argv[1];
+    int arg = 2;
+    int status = 0;
+    int stop = 0;
+    do {
+        int first_arg = arg;
+        const char *cursor = format;
+        while (*cursor != '\0' && !stop) {
+            if (*cursor == '\\') {
+                cursor++;
+                cursor += print_escape(cursor, 0, &stop);
+                continue;
+            } else if (*cursor != '%' || cursor[1] == '%') {
+                putchar(*cursor);
+                cursor += *cursor == '%' ? 2 : 1;
+                continue;
+            }
+            // Flags, width and precision are passed on to printf as they are
+            char spec[32] = "%";
+            size_t length = 1 + strspn(cursor + 1, "-+ #0123456789.");
+            if (length + 3 > sizeof(spec)) {
+                fprintf(stderr, "printf: %s: invalid format\n", cursor);
+                return 1;
+            }
+            memcpy(spec, cursor, length);
+            char conversion = cursor[length];
+            cursor += length + (conversion != '\0');
+            const char *value = arg < argc ? argv[arg++] : NULL;
+            switch (conversion) {
+                case 'd':
+                case 'i':
+                case 'o':
+                case 'u':
+                case 'x':
+                case 'X':
+                    spec[length] = 'l';
+                    spec[length + 1] = conversion;
+                    spec[length + 2] = '\0';
+                    printf(spec, printf_number(value, &status));
+                    break;
+                case 'c':
+                    if (value != NULL && value[0] != '\0') {
+                        spec[length] = 'c';
+                        spec[length + 1] = '\0';
+                        printf(spec, value[0]);
+                    }
+                    break;
+                case 's':
+                    spec[length] = 's';
+                    spec[length + 1] = '\0';
+                    printf(spec, value != NULL ? value : "");
+                    break;
+                case 'b':
+                    stop = value != NULL && print_escaped(value, 1);
+                    break;
+                default:
+                    fprintf(stderr, "printf: %%%c: invalid directive\n",
+                            conversion);
+                    return 1;
+            }
+        }
+        // A format without conversions is only printed once
+        if (arg == first_arg) {
+            break;
+        }
+    } while (arg < argc && !stop);
+    return status;
+}
+
+/* true and false, return 0 and 1 */
+int true_builtin(char *argv[], int argc) {
+    (void)argv;
+    (void)argc;
+    return 0;
+}
+
+int false_builtin(char *argv[], int argc) {
+    (void)argv;
+    (void)argc;
+    return 1;
+}
+
+/* pwd, prints the current directory */
+int pwd_builtin(char *argv[], int argc) {
+    char path[PATH_MAX];
+    (void)argv;
+    (void)argc;
+    if (getcwd(path, sizeof(path)) == NULL) {
+        perror("pwd");
+        return 1;
+    }
+    puts(path);
+    return 0;
+}
+
+/* creates a directory, which may already exist when parents is set */
+static int make_dir(const char *path, int parents) {
+    struct stat info;
+    if (mkdir(path, 0777) == 0 ||
+        (parents && errno == EEXIST && stat(path, &info) == 0 &&
+         S_ISDIR(info.st_mode))) {
+        return 0;
+    }
+    return -1;
+}
+
+/* mkdir [-p] dirs, creates each directory, and its parents with -p */
+int mkdir_builtin(char *argv[], int argc) {
+    int parents = 0;
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        parents |= is_option(argv[i]);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (is_option(argv[i])) {
+            continue;
+        }
+        char *path = argv[i];
+        // Every parent is created first, by cutting the path short at each
+        // of its slashes in turn
+        for (char *slash = strchr(path + 1, '/'); parents && slash != NULL;
+             slash = strchr(slash + 1, '/')) {
+            *slash = '\0';
+            int result = make_dir(path, 1);
+            *slash = '/';
+            if (result == -1) {
+                break;
+            }
+        }
+        if (make_dir(path, parents) == -1) {
+            fprintf(stderr, "mkdir: cannot create directory '%s': %s\n", path,
+                    strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* rmdir dirs, removes each empty directory */
+int rmdir_builtin(char *argv[], int argc) {
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (rmdir(argv[i]) == -1) {
+            fprintf(stderr, "rmdir: failed to remove '%s': %s\n", argv[i],
+                    strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/*
+ * moves a regular file to another file system by copying it and removing the
+ * original, returns 0 on success, -1 on failure with errno set
+ */
+static int move_file(const char *source, const char *target) {
+    struct stat info;
+    if (lstat(source, &info) == -1) {
+        return -1;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        errno = EXDEV;
+        return -1;
+    }
+    int in_fd = open(source, O_RDONLY | O_CLOEXEC);
+    if (in_fd == -1) {
+        return -1;
+    }
+    int out_fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      info.st_mode & 07777);
+    int result = out_fd == -1 || copy_fd(in_fd, out_fd) == -1 ||
+                         fchmod(out_fd, info.st_mode & 07777) == -1
+                     ? -1
+                     : 0;
+    int error = errno;
+    close(in_fd);
+    if (out_fd != -1 && close(out_fd) == -1) {
+        result = -1;
+        error = errno;
+    }
+    if (result == 0 && unlink(source) == -1) {
+        return -1;
+    }
+    errno = error;
+    return result;
+}
+
+/*
+ * mv source target and mv sources... dir, renames each source, copying and
+ * then removing regular files that have to move to another file system
+ */
+int mv_builtin(char *argv[], int argc) {
+    char *operands[512];
+    int count = 0;
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!is_option(argv[i])) {
+            operands[count++] = argv[i];
+        }
+    }
+    if (count < 2) {
+        fprintf(stderr, "mv: missing file operand\n");
+        return 1;
+    }
+    char *target = operands[count - 1];
+    struct stat info;
+    int into_dir = stat(target, &info) == 0 && S_ISDIR(info.st_mode);
+    if (count > 2 && !into_dir) {
+        fprintf(stderr, "mv: target '%s' is not a directory\n", target);
+        return 1;
+    }
+    for (int i = 0; i < count - 1; i++) {
+        char path[PATH_MAX];
+        const char *destination = target;
+        if (into_dir) {
+            char *name = strrchr(operands[i], '/');
+            name = name != NULL ? name + 1 : operands[i];
+            if (snprintf(path, sizeof(path), "%s/%s", target, name) >=
+                (int)sizeof(path)) {
+                fprintf(stderr, "mv: %s/%s: File name too long\n", target,
+                        name);
+                status = 1;
+                continue;
+            }
+            destination = path;
+        }
+        if (rename(operands[i], destination) == -1 &&
+            (errno != EXDEV || move_file(operands[i], destination) == -1)) {
+            fprintf(stderr, "mv: cannot move '%s' to '%s': %s\n", operands[i],
+                    destination, strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
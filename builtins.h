@@ -0,0 +1,46 @@
+#ifndef BUILTINS_H_
+#define BUILTINS_H_
+
+/*
+ * A builtin that stands in for an external command. It is run in the shell
+ * itself with argv and argc as the command would get them, and returns the
+ * command's exit status.
+ */
+typedef int (*builtin_t)(char *argv[], int argc);
+
+/*
+ * finds the builtin standing in for the command name, which is one of cat,
+ * echo, printf, true, false, pwd, mkdir, rmdir and mv, returns NULL if there
+ * is none or the arguments use options it does not handle, in which case the
+ * external command should be run instead
+ */
+builtin_t find_builtin(const char *name, char *argv[], int argc);
+
+/*
+ * cat, copies each file, or standard input for - or when no file is given, to
+ * standard output with copy_fd, so the data never passes through the shell
+ */
+int cat_builtin(char *argv[], int argc);
+/* echo [-neE] args, prints the arguments separated by spaces */
+int echo_builtin(char *argv[], int argc);
+/*
+ * printf format args, prints the arguments as described by format, which is
+ * reused for as long as arguments are left
+ */
+int printf_builtin(char *argv[], int argc);
+/* true and false, return 0 and 1 */
+int true_builtin(char *argv[], int argc);
+int false_builtin(char *argv[], int argc);
+/* pwd, prints the current directory */
+int pwd_builtin(char *argv[], int argc);
+/* mkdir [-p] dirs, creates each directory, and its parents with -p */
+int mkdir_builtin(char *argv[], int argc);
+/* rmdir dirs, removes each empty directory */
+int rmdir_builtin(char *argv[], int argc);
+/*
+ * mv source target and mv sources... dir, renames each source, copying and
+ * then removing regular files that have to move to another file system
+ */
+int mv_builtin(char *argv[], int argc);
+
+#endif  // BUILTINS_H_
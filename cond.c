@@ -0,0 +1,264 @@
+#include "./cond.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// args holds the operands of the expression and pos the next one to read
+// error is set once a problem has been reported so evaluation unwinds quietly
+typedef struct cond_state {
+    char **args;
+    int count;
+    int pos;
+    int error;
+} cond_state_t;
+
+static int parse_or(cond_state_t *state);
+
+/* reports an error once and marks the evaluation as failed */
+static int cond_error(cond_state_t *state, const char *msg, const char *arg) {
+    if (!state->error) {
+        if (arg != NULL) {
+            fprintf(stderr, "test: %s: %s\n", arg, msg);
+        } else {
+            fprintf(stderr, "test: %s\n", msg);
+        }
+        state->error = 1;
+    }
+    return 0;
+}
+
+/* returns 1 if op is a unary operator */
+static int is_unary_op(const char *op) {
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' &&
+           strchr("bcdefghkLnOGprsStuwxz", op[1]) != NULL;
+}
+
+/* returns 1 if op is a binary operator */
+static int is_binary_op(const char *op) {
+    const char *ops[] = {"=",   "==",  "!=",  "<",   ">",   "-eq", "-ne",
+                         "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"};
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (strcmp(op, ops[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* parses an integer operand, reporting an error if it is not one */
+static long parse_integer(cond_state_t *state, const char *arg) {
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0') {
+        return cond_error(state, "integer expression expected", arg);
+    }
+    return value;
+}
+
+/* evaluates a unary string or file predicate */
+static int eval_unary(cond_state_t *state, const char *op,
+                      const char *operand) {
+    struct stat info;
+    switch (op[1]) {
+        case 'z':
+            return operand[0] == '\0';
+        case 'n':
+            return operand[0] != '\0';
+        case 't':
+            return isatty((int)parse_integer(state, operand));
+        case 'r':
+            return access(operand, R_OK) == 0;
+        case 'w':
+            return access(operand, W_OK) == 0;
+        case 'x':
+            return access(operand, X_OK) == 0;
+        case 'L':
+        case 'h':
+            return lstat(operand, &info) == 0 && S_ISLNK(info.st_mode);
+        default:
+            break;
+    }
+    // Every remaining predicate only needs the file's metadata
+    if (stat(operand, &info) != 0) {
+        return 0;
+    }
+    switch (op[1]) {
+        case 'e':
+            return 1;
+        case 'f':
+            return S_ISREG(info.st_mode);
+        case 'd':
+            return S_ISDIR(info.st_mode);
+        case 'b':
+            return S_ISBLK(info.st_mode);
+        case 'c':
+            return S_ISCHR(info.st_mode);
+        case 'p':
+            return S_ISFIFO(info.st_mode);
+        case 'S':
+            return S_ISSOCK(info.st_mode);
+        case 's':
+            return info.st_size > 0;
+        case 'u':
+            return (info.st_mode & S_ISUID) != 0;
+        case 'g':
+            return (info.st_mode & S_ISGID) != 0;
+        case 'k':
+            return (info.st_mode & S_ISVTX) != 0;
+        case 'O':
+            return info.st_uid == geteuid();
+        case 'G':
+            return info.st_gid == getegid();
+        default:
+            return cond_error(state, "unknown unary operator", op);
+    }
+}
+
+/* compares the modification times of two files, missing files are oldest */
+static int compare_mtime(const char *left, const char *right) {
+    struct stat left_info, right_info;
+    int left_exists = stat(left, &left_info) == 0;
+    int right_exists = stat(right, &right_info) == 0;
+    if (!left_exists || !right_exists) {
+        return left_exists - right_exists;
+    }
+    if (left_info.st_mtim.tv_sec != right_info.st_mtim.tv_sec) {
+        return left_info.st_mtim.tv_sec < right_info.st_mtim.tv_sec ? -1 : 1;
+    }
+    if (left_info.st_mtim.tv_nsec != right_info.st_mtim.tv_nsec) {
+        return left_info.st_mtim.tv_nsec < right_info.st_mtim.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+/* evaluates a binary string, integer or file comparison */
+static int eval_binary(cond_state_t *state, const char *left, const char *op,
+                       const char *right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) == 0;
+    } else if (strcmp(op, "!=") == 0) {
+        return strcmp(left, right) != 0;
+    } else if (strcmp(op, "<") == 0) {
+        return strcmp(left, right) < 0;
+    } else if (strcmp(op, ">") == 0) {
+        return strcmp(left, right) > 0;
+    } else if (strcmp(op, "-nt") == 0) {
+        return compare_mtime(left, right) > 0;
+    } else if (strcmp(op, "-ot") == 0) {
+        return compare_mtime(left, right) < 0;
+    } else if (strcmp(op, "-ef") == 0) {
+        struct stat left_info, right_info;
+        return stat(left, &left_info) == 0 && stat(right, &right_info) == 0 &&
+               left_info.st_dev == right_info.st_dev &&
+               left_info.st_ino == right_info.st_ino;
+    }
+
+    long left_value = parse_integer(state, left);
+    long right_value = parse_integer(state, right);
+    if (strcmp(op, "-eq") == 0) {
+        return left_value == right_value;
+    } else if (strcmp(op, "-ne") == 0) {
+        return left_value != right_value;
+    } else if (strcmp(op, "-lt") == 0) {
+        return left_value < right_value;
+    } else if (strcmp(op, "-le") == 0) {
+        return left_value <= right_value;
+    } else if (strcmp(op, "-gt") == 0) {
+        return left_value > right_value;
+    }
+    return left_value >= right_value;
+}
+
+/* parses a comparison, a predicate, a parenthesized expression or a string */
+static int parse_primary(cond_state_t *state) {
+    if (state->pos >= state->count) {
+        return cond_error(state, "argument expected", NULL);
+    }
+    char **args = &state->args[state->pos];
+    int remaining = state->count - state->pos;
+    if (remaining >= 3 && is_binary_op(args[1])) {
+        state->pos += 3;
+        return eval_binary(state, args[0], args[1], args[2]);
+    }
+    if (strcmp(args[0], "(") == 0) {
+        state->pos++;
+        int value = parse_or(state);
+        if (state->pos >= state->count ||
+            strcmp(state->args[state->pos], ")") != 0) {
+            return cond_error(state, "missing ')'", NULL);
+        }
+        state->pos++;
+        return value;
+    }
+    if (remaining >= 2 && is_unary_op(args[0])) {
+        state->pos += 2;
+        return eval_unary(state, args[0], args[1]);
+    }
+    // A lone string is true when it is not empty
+    state->pos++;
+    return args[0][0] != '\0';
+}
+
+/* parses ! negations */
+static int parse_not(cond_state_t *state) {
+    if (state->pos + 1 < state->count &&
+        strcmp(state->args[state->pos], "!") == 0) {
+        state->pos++;
+        return !parse_not(state);
+    }
+    return parse_primary(state);
+}
+
+/* parses -a, which binds tighter than -o */
+static int parse_and(cond_state_t *state) {
+    int value = parse_not(state);
+    while (!state->error && state->pos < state->count &&
+           strcmp(state->args[state->pos], "-a") == 0) {
+        state->pos++;
+        int right = parse_not(state);
+        value = value && right;
+    }
+    return value;
+}
+
+/* parses -o */
+static int parse_or(cond_state_t *state) {
+    int value = parse_and(state);
+    while (!state->error && state->pos < state->count &&
+           strcmp(state->args[state->pos], "-o") == 0) {
+        state->pos++;
+        int right = parse_and(state);
+        value = value || right;
+    }
+    return value;
+}
+
+/*
+ * test and [ commands, evaluates the conditional expression in argv without
+ * leaving the shell. When invoked as [ the last argument must be ].
+ * returns 0 if the expression is true, 1 if it is false and 2 on error
+ */
+int test_builtin(char *argv[], int argc) {
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+    // No expression at all is false
+    if (argc == 1) {
+        return 1;
+    }
+    cond_state_t state = {argv + 1, argc - 1, 0, 0};
+    int value = parse_or(&state);
+    if (!state.error && state.pos != state.count) {
+        cond_error(&state, "too many arguments", NULL);
+    }
+    if (state.error) {
+        return 2;
+    }
+    return value ? 0 : 1;
+}
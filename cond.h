@@ -0,0 +1,11 @@
+#ifndef COND_H_
+#define COND_H_
+
+/*
+ * test and [ commands, evaluates the conditional expression in argv without
+ * leaving the shell. When invoked as [ the last argument must be ].
+ * returns 0 if the expression is true, 1 if it is false and 2 on error
+ */
+int test_builtin(char *argv[], int argc);
+
+#endif  // COND_H_
@@ -0,0 +1,115 @@
+#include "./copy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Most bytes asked for by one call that moves data inside the kernel
+#define COPY_CHUNK_SIZE (1 << 30)
+// Size of the buffer used when the data has to pass through the shell
+#define COPY_BUFFER_SIZE 131072
+
+typedef enum { COPY_RANGE, COPY_SPLICE, COPY_SENDFILE, COPY_BUFFER } method_t;
+
+/* returns 1 if a failed call only means its method does not apply here */
+static int unsupported(void) {
+    return errno == EINVAL || errno == ENOSYS || errno == EXDEV ||
+           errno == EOPNOTSUPP || errno == EBADF;
+}
+
+/*
+ * moves data with one of the kernel methods until the end of the input,
+ * returns 0 on success, 1 if the method does not apply and the next one
+ * should carry on from where it stopped, -1 on failure
+ */
+static int copy_in_kernel(method_t method, int in_fd, int out_fd) {
+    while (1) {
+        ssize_t copied;
+        switch (method) {
+            case COPY_RANGE:
+                copied = copy_file_range(in_fd, NULL, out_fd, NULL,
+                                         COPY_CHUNK_SIZE, 0);
+                break;
+            case COPY_SPLICE:
+                copied = splice(in_fd, NULL, out_fd, NULL, COPY_CHUNK_SIZE,
+                                SPLICE_F_MOVE | SPLICE_F_MORE);
+                break;
+            default:
+                copied = sendfile(out_fd, in_fd, NULL, COPY_CHUNK_SIZE);
+                break;
+        }
+        if (copied == 0) {
+            return 0;
+        } else if (copied == -1 && errno == EINTR) {
+            continue;
+        } else if (copied == -1) {
+            return unsupported() ? 1 : -1;
+        }
+    }
+}
+
+/* moves data through a buffer, returns 0 on success, -1 on failure */
+static int copy_buffered(int in_fd, int out_fd) {
+    static char buffer[COPY_BUFFER_SIZE];
+    while (1) {
+        ssize_t bytes_read = read(in_fd, buffer, sizeof(buffer));
+        if (bytes_read == 0) {
+            return 0;
+        } else if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else if (bytes_read == -1) {
+            return -1;
+        }
+        for (ssize_t written = 0; written < bytes_read;) {
+            ssize_t result =
+                write(out_fd, buffer + written, (size_t)(bytes_read - written));
+            if (result == -1 && errno != EINTR) {
+                return -1;
+            }
+            written += result > 0 ? result : 0;
+        }
+    }
+}
+
+/*
+ * copies everything that can be read from in_fd to out_fd, starting at their
+ * current offsets. The data is moved inside the kernel where the descriptors
+ * allow it, with copy_file_range between regular files, splice when either
+ * side is a pipe and sendfile from a regular file to anything else, and only
+ * goes through a buffer when none of those apply.
+ * returns 0 on success, -1 on failure with errno set, which is EINVAL if both
+ * are the same regular file
+ */
+int copy_fd(int in_fd, int out_fd) {
+    struct stat in_info, out_info;
+    if (fstat(in_fd, &in_info) == -1 || fstat(out_fd, &out_info) == -1) {
+        return -1;
+    }
+    // Appending a file to itself would never reach its end
+    if (S_ISREG(in_info.st_mode) && in_info.st_dev == out_info.st_dev &&
+        in_info.st_ino == out_info.st_ino) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Each method that applies is tried in turn, and a method that turns out
+    // not to be supported hands over to the next one without losing data
+    method_t methods[3];
+    int count = 0;
+    if (S_ISREG(in_info.st_mode) && S_ISREG(out_info.st_mode)) {
+        methods[count++] = COPY_RANGE;
+    }
+    if (S_ISFIFO(in_info.st_mode) || S_ISFIFO(out_info.st_mode)) {
+        methods[count++] = COPY_SPLICE;
+    }
+    if (S_ISREG(in_info.st_mode)) {
+        methods[count++] = COPY_SENDFILE;
+    }
+    for (int i = 0; i < count; i++) {
+        int result = copy_in_kernel(methods[i], in_fd, out_fd);
+        if (result != 1) {
+            return result;
+        }
+    }
+    return copy_buffered(in_fd, out_fd);
+}
@@ -0,0 +1,15 @@
+#ifndef COPY_H_
+#define COPY_H_
+
+/*
+ * copies everything that can be read from in_fd to out_fd, starting at their
+ * current offsets. The data is moved inside the kernel where the descriptors
+ * allow it, with copy_file_range between regular files, splice when either
+ * side is a pipe and sendfile from a regular file to anything else, and only
+ * goes through a buffer when none of those apply.
+ * returns 0 on success, -1 on failure with errno set, which is EINVAL if both
+ * are the same regular file
+ */
+int copy_fd(int in_fd, int out_fd);
+
+#endif  // COPY_H_
@@ -0,0 +1,9 @@
+#ifndef FDS_H_
+#define FDS_H_
+
+// Descriptors the shell keeps open for itself, such as the timerfd of the
+// deadlines of timeout, the signalfd for SIGCHLD and the /proc files of
+// jobs -s, are kept at this one or above, where exec may not redirect
+#define MIN_SHELL_FD 10
+
+#endif  // FDS_H_
@@ -0,0 +1,131 @@
+#include "./funcs.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct func_element {
+    char *name;
+    node_t *body;
+    struct func_element *next;
+};
+typedef struct func_element func_element_t;
+
+#define FUNC_BUCKETS 64
+
+// buckets is a hash table of functions chained through next
+struct func_table {
+    func_element_t *buckets[FUNC_BUCKETS];
+};
+
+/* hashes a function name with FNV-1a */
+static size_t hash_name(const char *name) {
+    size_t hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    return hash % FUNC_BUCKETS;
+}
+
+/* initializes an empty function table, returns pointer */
+func_table_t *init_func_table() {
+    return (func_table_t *)calloc(1, sizeof(func_table_t));
+}
+
+/*
+ * cleans up the function table, releasing every stored body
+ * Note: this function will free the func_table pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_func_table(func_table_t *func_table) {
+    if (func_table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < FUNC_BUCKETS; i++) {
+        func_element_t *cur = func_table->buckets[i];
+        while (cur != NULL) {
+            func_element_t *next = cur->next;
+            free(cur->name);
+            free_tree(cur->body);
+            free(cur);
+            cur = next;
+        }
+    }
+    free(func_table);
+}
+
+/*
+ * defines or redefines a function, the table keeps its own reference to the
+ * parsed body so it outlives the tree it was parsed in,
+ * returns 0 on success, -1 on failure
+ */
+int define_func(func_table_t *func_table, const char *name, node_t *body) {
+    if (func_table == NULL || body == NULL) {
+        return -1;
+    }
+    size_t bucket = hash_name(name);
+    func_element_t *cur = func_table->buckets[bucket];
+    while (cur != NULL && strcmp(cur->name, name) != 0) {
+        cur = cur->next;
+    }
+    if (cur == NULL) {
+        cur = (func_element_t *)malloc(sizeof(func_element_t));
+        if (cur == NULL) {
+            return -1;
+        }
+        cur->name = strdup(name);
+        if (cur->name == NULL) {
+            free(cur);
+            return -1;
+        }
+        cur->body = NULL;
+        cur->next = func_table->buckets[bucket];
+        func_table->buckets[bucket] = cur;
+    }
+    retain_tree(body);
+    // A call that is still running keeps its own reference to the old body
+    free_tree(cur->body);
+    cur->body = body;
+    return 0;
+}
+
+/* gets the parsed body of a function, returns NULL if it is not defined */
+node_t *get_func(func_table_t *func_table, const char *name) {
+    if (func_table == NULL) {
+        return NULL;
+    }
+    func_element_t *cur = func_table->buckets[hash_name(name)];
+    while (cur != NULL) {
+        if (strcmp(cur->name, name) == 0) {
+            return cur->body;
+        }
+        cur = cur->next;
+    }
+    return NULL;
+}
+
+/* removes a function, returns 0 on success, -1 on failure */
+int unset_func(func_table_t *func_table, const char *name) {
+    if (func_table == NULL) {
+        return -1;
+    }
+    size_t bucket = hash_name(name);
+    func_element_t *prev = NULL;
+    func_element_t *cur = func_table->buckets[bucket];
+    while (cur != NULL) {
+        if (strcmp(cur->name, name) == 0) {
+            if (prev != NULL) {
+                prev->next = cur->next;
+            } else {
+                func_table->buckets[bucket] = cur->next;
+            }
+            free(cur->name);
+            free_tree(cur->body);
+            free(cur);
+            return 0;
+        }
+        prev = cur;
+        cur = cur->next;
+    }
+    // Unsetting a function that does not exist is not an error
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef FUNCS_H_
+#define FUNCS_H_
+
+#include "./parser.h"
+
+typedef struct func_table func_table_t;
+
+/* initializes an empty function table, returns pointer */
+func_table_t *init_func_table();
+/*
+ * cleans up the function table, releasing every stored body
+ * Note: this function will free the func_table pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_func_table(func_table_t *func_table);
+
+/*
+ * defines or redefines a function, the table keeps its own reference to the
+ * parsed body so it outlives the tree it was parsed in,
+ * returns 0 on success, -1 on failure
+ */
+int define_func(func_table_t *func_table, const char *name, node_t *body);
+/* gets the parsed body of a function, returns NULL if it is not defined */
+node_t *get_func(func_table_t *func_table, const char *name);
+/* removes a function, returns 0 on success, -1 on failure */
+int unset_func(func_table_t *func_table, const char *name);
+
+#endif  // FUNCS_H_
@@ -0,0 +1,438 @@
+#include "./globs.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Size of the buffer directories are read into, large enough that most are
+// read with a single getdents64 call
+#define GLOB_BATCH_SIZE 65536
+
+// dev and ino identify the directory, mtime tells whether entries is stale
+// entries holds each name as its d_type byte followed by the NUL terminated
+// name, one after another
+struct glob_dir {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char *entries;
+    size_t length;
+    struct glob_dir *next;
+};
+typedef struct glob_dir glob_dir_t;
+
+struct glob_cache {
+    glob_dir_t *head;
+};
+
+// A pattern component is compiled into one of these for each character,
+// ? and * of the pattern, and for each [ ] class. set has a bit for each
+// character a class matches, with negation already applied.
+typedef enum { MATCH_CHAR, MATCH_ANY, MATCH_STAR, MATCH_CLASS } match_type_t;
+typedef struct match {
+    match_type_t type;
+    unsigned char c;
+    unsigned char set[32];
+} match_t;
+
+// path holds the part of the path matched so far
+// error is set once the matches no longer fit or memory runs out
+typedef struct glob_state {
+    glob_cache_t *cache;
+    arena_t *arena;
+    char **fields;
+    int count;
+    int max;
+    int error;
+    char path[PATH_MAX];
+} glob_state_t;
+
+/* initializes an empty directory cache, returns pointer */
+glob_cache_t *init_glob_cache() {
+    return (glob_cache_t *)calloc(1, sizeof(glob_cache_t));
+}
+
+/* forgets every directory read so far, done before each line is run */
+void reset_glob_cache(glob_cache_t *glob_cache) {
+    if (glob_cache == NULL) {
+        return;
+    }
+    glob_dir_t *cur = glob_cache->head;
+    while (cur != NULL) {
+        glob_dir_t *next = cur->next;
+        free(cur->entries);
+        free(cur);
+        cur = next;
+    }
+    glob_cache->head = NULL;
+}
+
+/*
+ * cleans up the directory cache
+ * Note: this function will free the glob_cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_glob_cache(glob_cache_t *glob_cache) {
+    reset_glob_cache(glob_cache);
+    free(glob_cache);
+}
+
+/* returns the length of the [ ] class starting at pattern, 0 if unclosed */
+static size_t class_length(const char *pattern, size_t length) {
+    size_t end = 1;
+    if (end < length && (pattern[end] == '!' || pattern[end] == '^')) {
+        end++;
+    }
+    // A ] right after the opening bracket is part of the class
+    if (end < length && pattern[end] == ']') {
+        end++;
+    }
+    while (end < length && pattern[end] != ']') {
+        end++;
+    }
+    return end < length ? end + 1 : 0;
+}
+
+/* returns 1 if the first length characters of word hold a wildcard */
+static int has_wildcard(const char *word, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (word[i] == '*' || word[i] == '?' ||
+            (word[i] == '[' && class_length(word + i, length - i) != 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* returns 1 if word contains a *, ? or [ ] wildcard, 0 otherwise */
+int has_glob(const char *word) {
+    return has_wildcard(word, strlen(word));
+}
+
+/* fills in the bits of a class whose brackets have been checked */
+static void compile_class(const char *pattern, size_t length, match_t *op) {
+    size_t pos = 1;
+    int negate = pattern[pos] == '!' || pattern[pos] == '^';
+    pos += (size_t)negate;
+    memset(op->set, 0, sizeof(op->set));
+    size_t first = pos;
+    while (pos < length - 1 && (pattern[pos] != ']' || pos == first)) {
+        unsigned int low = (unsigned char)pattern[pos];
+        unsigned int high = low;
+        if (pos + 2 < length - 1 && pattern[pos + 1] == '-') {
+            high = (unsigned char)pattern[pos + 2];
+            pos += 2;
+        }
+        for (unsigned int c = low; c <= high; c++) {
+            op->set[c >> 3] = (unsigned char)(op->set[c >> 3] | (1 << (c & 7)));
+        }
+        pos++;
+    }
+    if (negate) {
+        for (size_t i = 0; i < sizeof(op->set); i++) {
+            op->set[i] = (unsigned char)~op->set[i];
+        }
+    }
+}
+
+/*
+ * compiles the first length characters of a pattern component into ops,
+ * which has room for length entries, returns the number of entries used
+ */
+static size_t compile_pattern(const char *pattern, size_t length,
+                              match_t *ops) {
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < length) {
+        match_t *op = &ops[count++];
+        size_t class = 0;
+        if (pattern[pos] == '*') {
+            op->type = MATCH_STAR;
+            // Consecutive stars match the same as one
+            while (pos < length && pattern[pos] == '*') {
+                pos++;
+            }
+            continue;
+        } else if (pattern[pos] == '?') {
+            op->type = MATCH_ANY;
+        } else if (pattern[pos] == '[' &&
+                   (class = class_length(pattern + pos, length - pos)) != 0) {
+            op->type = MATCH_CLASS;
+            compile_class(pattern + pos, class, op);
+            pos += class;
+            continue;
+        } else {
+            op->type = MATCH_CHAR;
+            op->c = (unsigned char)pattern[pos];
+        }
+        pos++;
+    }
+    return count;
+}
+
+/* returns 1 if a single character matches op, which is not a star */
+static int match_one(const match_t *op, unsigned char c) {
+    switch (op->type) {
+        case MATCH_CHAR:
+            return op->c == c;
+        case MATCH_CLASS:
+            return (op->set[c >> 3] >> (c & 7)) & 1;
+        default:
+            return 1;
+    }
+}
+
+/*
+ * returns 1 if name matches the compiled pattern, 0 otherwise. After a
+ * mismatch only the most recent star is retried with one more character, which
+ * is enough to find a match if there is one.
+ */
+static int match_name(const match_t *ops, size_t count, const char *name) {
+    size_t op = 0;
+    size_t star_op = 0;
+    const char *star_name = NULL;
+    while (*name != '\0') {
+        if (op < count && ops[op].type == MATCH_STAR) {
+            star_op = ++op;
+            star_name = name;
+        } else if (op < count && match_one(&ops[op], (unsigned char)*name)) {
+            op++;
+            name++;
+        } else if (star_name != NULL) {
+            op = star_op;
+            name = ++star_name;
+        } else {
+            return 0;
+        }
+    }
+    while (op < count && ops[op].type == MATCH_STAR) {
+        op++;
+    }
+    return op == count;
+}
+
+/* reads every entry of the open directory fd into dir, returns 0 on success,
+ * -1 on failure */
+static int read_dir(glob_dir_t *dir, int fd) {
+    static struct dirent64 batch[GLOB_BATCH_SIZE / sizeof(struct dirent64)];
+    size_t capacity = 0;
+    dir->length = 0;
+    ssize_t bytes_read;
+    while ((bytes_read = getdents64(fd, batch, sizeof(batch))) > 0) {
+        for (ssize_t offset = 0; offset < bytes_read;) {
+            struct dirent64 *entry =
+                (struct dirent64 *)((char *)batch + offset);
+            offset += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+            size_t size = strlen(name) + 2;
+            if (dir->length + size > capacity) {
+                capacity = capacity * 2 > dir->length + size
+                               ? capacity * 2
+                               : dir->length + size + 4096;
+                char *grown = (char *)realloc(dir->entries, capacity);
+                if (grown == NULL) {
+                    return -1;
+                }
+                dir->entries = grown;
+            }
+            dir->entries[dir->length] = (char)entry->d_type;
+            memcpy(dir->entries + dir->length + 1, name, size - 1);
+            dir->length += size;
+        }
+    }
+    return bytes_read == -1 ? -1 : 0;
+}
+
+/*
+ * gets the entries of the directory at path, reading it only if it is not
+ * cached or has been modified since, returns NULL if it cannot be read
+ */
+static glob_dir_t *get_dir(glob_cache_t *cache, const char *path) {
+    struct stat info;
+    if (stat(path, &info) == -1 || !S_ISDIR(info.st_mode)) {
+        return NULL;
+    }
+    glob_dir_t *dir = cache->head;
+    while (dir != NULL && (dir->dev != info.st_dev || dir->ino != info.st_ino)) {
+        dir = dir->next;
+    }
+    if (dir != NULL && dir->mtime.tv_sec == info.st_mtim.tv_sec &&
+        dir->mtime.tv_nsec == info.st_mtim.tv_nsec) {
+        return dir;
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (dir == NULL) {
+        dir = (glob_dir_t *)calloc(1, sizeof(glob_dir_t));
+        if (dir == NULL) {
+            close(fd);
+            return NULL;
+        }
+        dir->dev = info.st_dev;
+        dir->ino = info.st_ino;
+        dir->next = cache->head;
+        cache->head = dir;
+    }
+    // The time is taken before reading, so changes made meanwhile are seen
+    // the next time
+    dir->mtime = info.st_mtim;
+    if (read_dir(dir, fd) == -1) {
+        dir->length = 0;
+        dir->mtime.tv_sec = -1;
+    }
+    close(fd);
+    return dir;
+}
+
+/* stores the path matched so far as the next result */
+static void add_match(glob_state_t *state, size_t length) {
+    if (state->count == state->max) {
+        state->error = 1;
+        return;
+    }
+    if (arena_append(state->arena, state->path, length) == -1) {
+        state->error = 1;
+        return;
+    }
+    char *match = arena_finish(state->arena);
+    if (match == NULL) {
+        state->error = 1;
+        return;
+    }
+    state->fields[state->count++] = match;
+}
+
+/* appends count characters to the path, returns 0 on success, -1 if the path
+ * gets too long */
+static int append_path(glob_state_t *state, size_t *length, const char *src,
+                       size_t count) {
+    if (*length + count >= sizeof(state->path)) {
+        return -1;
+    }
+    memcpy(state->path + *length, src, count);
+    *length += count;
+    state->path[*length] = '\0';
+    return 0;
+}
+
+/*
+ * matches the rest of the pattern against the directory named by the first
+ * length characters of state->path, adding every path that matches
+ */
+static void glob_component(glob_state_t *state, size_t length,
+                           const char *pattern) {
+    if (*pattern == '\0') {
+        add_match(state, length);
+        return;
+    }
+    size_t component = strcspn(pattern, "/");
+    const char *rest = pattern + component;
+    size_t slashes = strspn(rest, "/");
+
+    // Components without wildcards are taken as they are, the last one only
+    // if it exists
+    if (!has_wildcard(pattern, component)) {
+        struct stat info;
+        size_t end = length;
+        if (append_path(state, &end, pattern, component + slashes) == 0 &&
+            (rest[slashes] != '\0' || lstat(state->path, &info) == 0)) {
+            glob_component(state, end, rest + slashes);
+        }
+        return;
+    }
+
+    match_t *ops = (match_t *)malloc(component * sizeof(match_t));
+    if (ops == NULL) {
+        state->error = 1;
+        return;
+    }
+    size_t count = compile_pattern(pattern, component, ops);
+    glob_dir_t *dir = get_dir(state->cache, length == 0 ? "." : state->path);
+    // Hidden names have to be matched with a leading '.'
+    int match_hidden = pattern[0] == '.';
+    for (size_t offset = 0; dir != NULL && offset < dir->length;) {
+        unsigned char type = (unsigned char)dir->entries[offset];
+        const char *name = dir->entries + offset + 1;
+        size_t name_length = strlen(name);
+        offset += name_length + 2;
+        if ((name[0] == '.' && !match_hidden) ||
+            !match_name(ops, count, name)) {
+            continue;
+        }
+        size_t end = length;
+        if (append_path(state, &end, name, name_length) == -1) {
+            continue;
+        }
+        if (slashes > 0) {
+            // Only directories can hold the rest of the pattern
+            struct stat info;
+            if (type != DT_DIR &&
+                ((type != DT_LNK && type != DT_UNKNOWN) ||
+                 stat(state->path, &info) == -1 || !S_ISDIR(info.st_mode))) {
+                continue;
+            }
+            if (append_path(state, &end, rest, slashes) == -1) {
+                continue;
+            }
+        }
+        glob_component(state, end, rest + slashes);
+        if (state->error) {
+            break;
+        }
+    }
+    free(ops);
+}
+
+/* orders paths by their bytes */
+static int compare_paths(const void *left, const void *right) {
+    return strcmp(*(char *const *)left, *(char *const *)right);
+}
+
+/*
+ * expands a pathname pattern that may use *, ? and [ ] (negated with ! or ^)
+ * in any of its components. Each matching path is stored in arena and a
+ * pointer to it is added to fields starting at index, in sorted order. Names
+ * starting with a '.' are only matched by a pattern that starts with one.
+ * Directories are read once and kept in the cache until it is reset, and
+ * only read again if they have been modified since.
+ * returns the number of paths stored, 0 if nothing matched, or -1 if they do
+ * not fit before max or memory ran out
+ */
+int expand_glob(glob_cache_t *glob_cache, arena_t *arena, const char *pattern,
+                char *fields[], int index, int max) {
+    glob_state_t *state = (glob_state_t *)malloc(sizeof(glob_state_t));
+    if (state == NULL) {
+        return -1;
+    }
+    state->cache = glob_cache;
+    state->arena = arena;
+    state->fields = fields;
+    state->count = index;
+    state->max = max;
+    state->error = 0;
+
+    // Absolute patterns start from the root directory
+    size_t length = strspn(pattern, "/");
+    memcpy(state->path, pattern, length);
+    state->path[length] = '\0';
+    arena_truncate(arena, 0);
+    glob_component(state, length, pattern + length);
+
+    int count = state->count - index;
+    int error = state->error;
+    free(state);
+    if (error) {
+        return -1;
+    }
+    qsort(fields + index, (size_t)count, sizeof(char *), compare_paths);
+    return count;
+}
@@ -0,0 +1,35 @@
+#ifndef GLOBS_H_
+#define GLOBS_H_
+
+#include "./arena.h"
+
+typedef struct glob_cache glob_cache_t;
+
+/* initializes an empty directory cache, returns pointer */
+glob_cache_t *init_glob_cache();
+/*
+ * cleans up the directory cache
+ * Note: this function will free the glob_cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_glob_cache(glob_cache_t *glob_cache);
+/* forgets every directory read so far, done before each line is run */
+void reset_glob_cache(glob_cache_t *glob_cache);
+
+/* returns 1 if word contains a *, ? or [ ] wildcard, 0 otherwise */
+int has_glob(const char *word);
+
+/*
+ * expands a pathname pattern that may use *, ? and [ ] (negated with ! or ^)
+ * in any of its components. Each matching path is stored in arena and a
+ * pointer to it is added to fields starting at index, in sorted order. Names
+ * starting with a '.' are only matched by a pattern that starts with one.
+ * Directories are read once and kept in the cache until it is reset, and
+ * only read again if they have been modified since.
+ * returns the number of paths stored, 0 if nothing matched, or -1 if they do
+ * not fit before max or memory ran out
+ */
+int expand_glob(glob_cache_t *glob_cache, arena_t *arena, const char *pattern,
+                char *fields[], int index, int max);
+
+#endif  // GLOBS_H_
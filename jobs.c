@@ -1,32 +1,86 @@
 #include "./jobs.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "./fds.h"
 
 struct job_element {
     int jid;
     pid_t pid;
     process_state_t state;
     char *command;
+    // what the caller needs to start a queued job, NULL once it has started
+    void *data;
+    // JIDs of the jobs a waiting job still waits for, and whether it is
+    // cancelled if one of them fails
+    int *after;
+    int after_count;
+    int after_success;
+    // /proc/<pid>/stat and statm of the job, opened the first time it is
+    // sampled and read again with pread after that, -1 until then
+    int stat_fd;
+    int statm_fd;
+    // CPU time the job had used at its last sample, in clock ticks, and
+    // when that was, in seconds since boot
+    unsigned long long cpu_ticks;
+    double sampled_at;
     struct job_element *next;
 };
 typedef struct job_element job_element_t;
 
+// a process started on behalf of a job, such as the command behind a process
+// substitution, which has no entry of its own in the list
+struct helper_element {
+    int jid;
+    pid_t pid;
+    struct helper_element *next;
+};
+typedef struct helper_element helper_element_t;
+
+// how a job that has left the list ended, kept for the jobs that wait for it
+#define JOB_SUCCEEDED 1
+#define JOB_FAILED 2
+
 // head is the head of the list
 // current is the current element being iterated over
+// helpers are the helper processes that have not been reaped yet
+// outcomes holds JOB_SUCCEEDED or JOB_FAILED for every finished JID below
+// outcome_count, and 0 for the others
 struct job_list {
     job_element_t *head;
     job_element_t *current;
+    helper_element_t *helpers;
     pid_t shell_pid;
+    char *outcomes;
+    int outcome_count;
 };
 
+/* closes the /proc files of a job that has been sampled */
+static void close_stat_fds(job_element_t *job) {
+    if (job->stat_fd != -1) {
+        close(job->stat_fd);
+        job->stat_fd = -1;
+    }
+    if (job->statm_fd != -1) {
+        close(job->statm_fd);
+        job->statm_fd = -1;
+    }
+}
+
 /* initializes job list, returns pointer */
 job_list_t *init_job_list() {
     job_list_t *job_list = (job_list_t *)malloc(sizeof(job_list_t));
     job_list->head = NULL;
     job_list->current = NULL;
+    job_list->helpers = NULL;
     job_list->shell_pid = getpid();
+    job_list->outcomes = NULL;
+    job_list->outcome_count = 0;
     return job_list;
 }
 
@@ -44,10 +98,13 @@ void cleanup_job_list(job_list_t *job_list) {
     while (cur != NULL) {
         job_element_t *nextElement = cur->next;
 
-        // if we are cleaning up the shell's job list and not a child's
-        if (getpid() == job_list->shell_pid) {
-            /* kill process */
-            if (kill(-cur->pid, SIGKILL) < 0) {
+        // if we are cleaning up the shell's job list and not a child's, and
+        // the job has a process at all
+        if (getpid() == job_list->shell_pid && cur->pid != 0) {
+            /* kill process, or just the job's own process when it was
+             * started without a process group of its own */
+            if (kill(-cur->pid, SIGKILL) < 0 &&
+                (errno != ESRCH || kill(cur->pid, SIGKILL) < 0)) {
                 perror("kill");
             }
         }
@@ -56,29 +113,51 @@ void cleanup_job_list(job_list_t *job_list) {
             free(cur->command);
             cur->command = NULL;
         }
+        free(cur->after);
+        close_stat_fds(cur);
 
         free(cur);
         cur = nextElement;
     }
 
+    helper_element_t *helper = job_list->helpers;
+    while (helper != NULL) {
+        helper_element_t *next_helper = helper->next;
+        // Helpers of foreground commands are left to finish with them
+        if (getpid() == job_list->shell_pid && helper->jid != 0 &&
+            kill(helper->pid, SIGKILL) < 0 && errno != ESRCH) {
+            perror("kill");
+        }
+        free(helper);
+        helper = next_helper;
+    }
+
     job_list->head = NULL;
     job_list->current = NULL;
+    job_list->helpers = NULL;
     job_list->shell_pid = 0;
+    free(job_list->outcomes);
 
     free(job_list);
 }
 
-/* adds new job to list, returns 0 on success, -1 on failure */
-int add_job(job_list_t *job_list, int jid, pid_t pid, process_state_t state,
-            char *command) {
-    if (job_list == NULL || (state != RUNNING && state != STOPPED) ||
-        command == NULL) {
+/* adds new job to the end of the list, returns 0 on success, -1 on failure */
+static int append_job(job_list_t *job_list, int jid, pid_t pid,
+                      process_state_t state, char *command, void *data) {
+    job_element_t *new = (job_element_t *)malloc(sizeof(job_element_t));
+    if (new == NULL) {
         return -1;
     }
-
-    job_element_t *new = (job_element_t *)malloc(sizeof(job_element_t));
     new->jid = jid;
     new->pid = pid;
+    new->data = data;
+    new->after = NULL;
+    new->after_count = 0;
+    new->after_success = 0;
+    new->stat_fd = -1;
+    new->statm_fd = -1;
+    new->cpu_ticks = 0;
+    new->sampled_at = 0;
 
     // allocate new char*'s and copy buffers in to protect our code
     new->state = state;
@@ -105,6 +184,218 @@ int add_job(job_list_t *job_list, int jid, pid_t pid, process_state_t state,
     return 0;
 }
 
+/* adds new job to list, returns 0 on success, -1 on failure */
+int add_job(job_list_t *job_list, int jid, pid_t pid, process_state_t state,
+            char *command) {
+    if (job_list == NULL || (state != RUNNING && state != STOPPED) ||
+        command == NULL) {
+        return -1;
+    }
+
+    return append_job(job_list, jid, pid, state, command, NULL);
+}
+
+/*
+ * adds a job that has not been started yet to the end of the list, in the
+ * QUEUED state and without a PID, returns 0 on success, -1 on failure
+ */
+int queue_job(job_list_t *job_list, int jid, char *command, void *data) {
+    if (job_list == NULL || command == NULL) {
+        return -1;
+    }
+
+    return append_job(job_list, jid, 0, QUEUED, command, data);
+}
+
+/*
+ * marks a job that has not been started yet as RUNNING once its process has
+ * been started, given the job's JID, returns 0 on success, -1 on failure
+ */
+int start_job(job_list_t *job_list, int jid, pid_t pid) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_element_t *cur = job_list->head;
+    while (cur != NULL) {
+        if (cur->jid == jid && cur->pid == 0) {
+            cur->pid = pid;
+            cur->state = RUNNING;
+            cur->data = NULL;
+            cur->after_count = 0;
+            return 0;
+        }
+
+        cur = cur->next;
+    }
+
+    return -1;
+}
+
+/*
+ * gets JID of the first job in the list in the given state, which is the
+ * oldest one as jobs are added at the tail, returns -1 if there is none
+ */
+int find_job_jid(job_list_t *job_list, process_state_t state) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_element_t *cur = job_list->head;
+    while (cur != NULL) {
+        if (cur->state == state) {
+            return cur->jid;
+        }
+
+        cur = cur->next;
+    }
+
+    return -1;
+}
+
+/*
+ * gets data of a job that has not been started yet, given job's JID,
+ * returns NULL on failure
+ */
+void *get_queued_data(job_list_t *job_list, int jid) {
+    if (job_list == NULL) {
+        return NULL;
+    }
+
+    job_element_t *cur = job_list->head;
+    while (cur != NULL) {
+        if (cur->jid == jid) {
+            return cur->pid == 0 ? cur->data : NULL;
+        }
+
+        cur = cur->next;
+    }
+
+    return NULL;
+}
+
+/*
+ * makes a queued job wait for the jobs with the given JIDs to finish, and
+ * with require_success for each of them to exit with status 0 as well,
+ * returns the number of jobs it waits for on success, -1 on failure
+ * The job is WAITING until then, unless none of the JIDs are in the list, as
+ * those jobs have finished already. It is CANCELLED right away, to be
+ * removed by the caller, if it requires success and one of those failed.
+ */
+int add_job_dependencies(job_list_t *job_list, int jid, int after[],
+                         int count, int require_success) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    job_element_t *job = NULL;
+    for (job_element_t *cur = job_list->head; cur != NULL; cur = cur->next) {
+        if (cur->jid == jid && cur->state == QUEUED) {
+            job = cur;
+        }
+    }
+    if (job == NULL) {
+        return -1;
+    }
+    int *pending = (int *)malloc(sizeof(int) * (size_t)(count + 1));
+    if (pending == NULL) {
+        return -1;
+    }
+    int pending_count = 0;
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        job_element_t *cur = job_list->head;
+        while (cur != NULL && (cur->jid != after[i] || cur == job)) {
+            cur = cur->next;
+        }
+        if (cur != NULL) {
+            pending[pending_count++] = after[i];
+        } else if (after[i] > 0 && after[i] < job_list->outcome_count &&
+                   job_list->outcomes[after[i]] == JOB_FAILED) {
+            failed = 1;
+        }
+    }
+
+    free(job->after);
+    job->after = pending;
+    job->after_count = pending_count;
+    job->after_success = require_success;
+    if (require_success && failed) {
+        job->state = CANCELLED;
+    } else if (pending_count > 0) {
+        job->state = WAITING;
+    }
+    return pending_count;
+}
+
+/* records how the job with the given JID ended */
+static void record_outcome(job_list_t *job_list, int jid, int success) {
+    if (jid < 1) {
+        return;
+    }
+    if (jid >= job_list->outcome_count) {
+        int outcome_count = 2 * jid + 16;
+        char *grown = (char *)realloc(job_list->outcomes, (size_t)outcome_count);
+        if (grown == NULL) {
+            return;
+        }
+        memset(grown + job_list->outcome_count, 0,
+               (size_t)(outcome_count - job_list->outcome_count));
+        job_list->outcomes = grown;
+        job_list->outcome_count = outcome_count;
+    }
+    job_list->outcomes[jid] = success ? JOB_SUCCEEDED : JOB_FAILED;
+}
+
+/*
+ * releases the jobs waiting for the job with the given JID once it has
+ * finished, with success set if it exited with status 0. Jobs that waited
+ * for nothing else are QUEUED, and those that required it to succeed when
+ * it did not are CANCELLED, to be removed by the caller.
+ */
+void release_jobs(job_list_t *job_list, int jid, int success) {
+    if (job_list == NULL) {
+        return;
+    }
+    // Jobs queued later still have to know how it ended
+    record_outcome(job_list, jid, success);
+
+    for (job_element_t *cur = job_list->head; cur != NULL; cur = cur->next) {
+        if (cur->state != WAITING) {
+            continue;
+        }
+        int waited = 0;
+        for (int i = 0; i < cur->after_count; i++) {
+            if (cur->after[i] == jid) {
+                // the same JID may have been given more than once
+                cur->after[i--] = cur->after[--cur->after_count];
+                waited = 1;
+            }
+        }
+        if (waited && cur->after_success && !success) {
+            cur->state = CANCELLED;
+        } else if (cur->after_count == 0) {
+            cur->state = QUEUED;
+        }
+    }
+}
+
+/* returns the number of jobs in the list in the given state */
+int count_jobs(job_list_t *job_list, process_state_t state) {
+    if (job_list == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    for (job_element_t *cur = job_list->head; cur != NULL; cur = cur->next) {
+        if (cur->state == state) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
 /* removes job from list, given job's JID,
     returns 0 on success, -1 on failure */
 int remove_job_jid(job_list_t *job_list, int jid) {
@@ -130,6 +421,8 @@ int remove_job_jid(job_list_t *job_list, int jid) {
                 free(cur->command);
                 cur->command = NULL;
             }
+            free(cur->after);
+            close_stat_fds(cur);
 
             free(cur);
             cur = NULL;
@@ -169,6 +462,8 @@ int remove_job_pid(job_list_t *job_list, pid_t pid) {
                 free(cur->command);
                 cur->command = NULL;
             }
+            free(cur->after);
+            close_stat_fds(cur);
             free(cur);
             cur = NULL;
 
@@ -220,7 +515,10 @@ int update_job_pid(job_list_t *job_list, pid_t pid, process_state_t state) {
     return -1;
 }
 
-/* gets PID of job, given job's JID, returns PID on success, -1 on failure */
+/*
+ * gets PID of job, given job's JID, returns PID on success, 0 if the job is
+ * still queued, -1 on failure
+ */
 pid_t get_job_pid(job_list_t *job_list, int jid) {
     if (job_list == NULL) {
         return -1;
@@ -277,6 +575,57 @@ pid_t get_next_pid(job_list_t *job_list) {  // circular iterator
     }
 }
 
+/* returns 1 if there are any jobs in the list, 0 otherwise */
+int has_jobs(job_list_t *job_list) {
+    return job_list != NULL &&
+           (job_list->head != NULL || job_list->helpers != NULL);
+}
+
+/*
+ * adds a helper process started for the job with the given JID, or for a
+ * foreground command when jid is 0, returns 0 on success, -1 on failure
+ */
+int add_job_helper(job_list_t *job_list, int jid, pid_t pid) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    helper_element_t *new = (helper_element_t *)malloc(sizeof(helper_element_t));
+    if (new == NULL) {
+        return -1;
+    }
+    new->jid = jid;
+    new->pid = pid;
+    new->next = job_list->helpers;
+    job_list->helpers = new;
+
+    return 0;
+}
+
+/*
+ * removes a helper process once it has been reaped, given its PID
+ * returns the JID it was started for on success, -1 if it is not a helper
+ */
+int remove_job_helper(job_list_t *job_list, pid_t pid) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    helper_element_t **link = &job_list->helpers;
+    while (*link != NULL) {
+        helper_element_t *cur = *link;
+        if (cur->pid == pid) {
+            int jid = cur->jid;
+            *link = cur->next;
+            free(cur);
+            return jid;
+        }
+        link = &cur->next;
+    }
+
+    return -1;
+}
+
 /* jobs command, prints out the jobs list */
 void jobs(job_list_t *job_list) {
     if (job_list == NULL) {
@@ -285,9 +634,25 @@ void jobs(job_list_t *job_list) {
 
     job_element_t *cur = job_list->head;
     while (cur != NULL) {
-        char *state_string = cur->state == RUNNING ? "Running" : "Stopped";
-        if (printf("[%d] (%d) %s %s\n", cur->jid, cur->pid, state_string,
-                   cur->command) < 0) {
+        int printed;
+        if (cur->state == QUEUED) {
+            // A queued job has no process to show yet
+            printed = printf("[%d] Queued %s\n", cur->jid, cur->command);
+        } else if (cur->state == WAITING || cur->state == CANCELLED) {
+            // Nor does a waiting one, which shows the jobs it waits for
+            printed = printf("[%d] Waiting", cur->jid);
+            for (int i = 0; printed >= 0 && i < cur->after_count; i++) {
+                printed = printf(" %%%d", cur->after[i]);
+            }
+            if (printed >= 0) {
+                printed = printf(" %s\n", cur->command);
+            }
+        } else {
+            char *state_string = cur->state == RUNNING ? "Running" : "Stopped";
+            printed = printf("[%d] (%d) %s %s\n", cur->jid, cur->pid,
+                             state_string, cur->command);
+        }
+        if (printed < 0) {
             fprintf(stderr, "error printing jobs list\n");
             cleanup_job_list(job_list);
             exit(1);
@@ -295,3 +660,126 @@ void jobs(job_list_t *job_list) {
         cur = cur->next;
     }
 }
+
+/*
+ * reads a /proc file of a job into buffer through the descriptor cached in
+ * fd, opening it first if it is not open yet, returns the number of bytes
+ * read, or -1 if the process is gone
+ */
+static ssize_t read_proc_file(pid_t pid, const char *name, int *fd,
+                              char *buffer, size_t size) {
+    if (*fd == -1) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+        // Commands must not inherit it, and as it stays open for as long as
+        // the job does, it is moved out of the way of the low descriptors
+        // scripts redirect with exec
+        int opened = open(path, O_RDONLY | O_CLOEXEC);
+        if (opened == -1) {
+            return -1;
+        }
+        *fd = fcntl(opened, F_DUPFD_CLOEXEC, MIN_SHELL_FD);
+        close(opened);
+        if (*fd == -1) {
+            return -1;
+        }
+    }
+    // Reading from the start again fills in the current values
+    ssize_t bytes_read = pread(*fd, buffer, size - 1, 0);
+    if (bytes_read <= 0) {
+        return -1;
+    }
+    buffer[bytes_read] = '\0';
+    return bytes_read;
+}
+
+/*
+ * samples the state, CPU usage and resident memory of a job, with the CPU
+ * usage taken since its previous sample, or over its whole life at its first
+ * one, returns 0 on success, -1 if the process is gone
+ */
+static int sample_job(job_element_t *job, char *state, double *cpu,
+                      unsigned long long *rss) {
+    char buffer[1024];
+    if (read_proc_file(job->pid, "stat", &job->stat_fd, buffer,
+                       sizeof(buffer)) == -1) {
+        return -1;
+    }
+    // The command name is in parentheses and may hold both spaces and
+    // parentheses of its own, so the fields are read from after the last one
+    char *fields = strrchr(buffer, ')');
+    unsigned long utime;
+    unsigned long stime;
+    unsigned long long start_time;
+    if (fields == NULL ||
+        sscanf(fields + 1,
+               " %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d "
+               "%*d %*d %*d %*d %llu",
+               state, &utime, &stime, &start_time) != 4) {
+        return -1;
+    }
+    if (read_proc_file(job->pid, "statm", &job->statm_fd, buffer,
+                       sizeof(buffer)) == -1 ||
+        sscanf(buffer, "%*u %llu", rss) != 1) {
+        return -1;
+    }
+    *rss *= (unsigned long long)sysconf(_SC_PAGESIZE) / 1024;
+
+    // The start time is counted in clock ticks since boot
+    double ticks_per_second = (double)sysconf(_SC_CLK_TCK);
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    double seconds = (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+    unsigned long long ticks = (unsigned long long)utime + stime;
+    if (job->sampled_at <= 0) {
+        job->sampled_at = (double)start_time / ticks_per_second;
+        job->cpu_ticks = 0;
+    }
+    double elapsed = seconds - job->sampled_at;
+    *cpu = elapsed > 0 ? 100.0 * (double)(ticks - job->cpu_ticks) /
+                             ticks_per_second / elapsed
+                       : 0;
+    job->cpu_ticks = ticks;
+    job->sampled_at = seconds;
+    return 0;
+}
+
+/*
+ * jobs -s command, prints the state, CPU usage and resident memory of every
+ * job with a process, returns 0 on success, -1 on failure
+ */
+int job_stats(job_list_t *job_list) {
+    if (job_list == NULL) {
+        return -1;
+    }
+
+    if (printf("%-5s %-7s %s %6s %9s %s\n", "JOB", "PID", "S", "CPU%", "RSS",
+               "COMMAND") < 0) {
+        return -1;
+    }
+    job_element_t *cur = job_list->head;
+    while (cur != NULL) {
+        char state;
+        double cpu;
+        unsigned long long rss;
+        // Queued and waiting jobs have no process to sample yet
+        if (cur->pid != 0) {
+            char jid[16];
+            snprintf(jid, sizeof(jid), "[%d]", cur->jid);
+            int printed;
+            if (sample_job(cur, &state, &cpu, &rss) == -1) {
+                // It has exited, but has not been reaped yet
+                printed = printf("%-5s %-7d %s %6s %9s %s\n", jid, cur->pid,
+                                 "-", "-", "-", cur->command);
+            } else {
+                printed = printf("%-5s %-7d %c %6.1f %8lluK %s\n", jid,
+                                 cur->pid, state, cpu, rss, cur->command);
+            }
+            if (printed < 0) {
+                return -1;
+            }
+        }
+        cur = cur->next;
+    }
+    return 0;
+}
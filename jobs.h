@@ -4,7 +4,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-typedef enum { RUNNING, STOPPED } process_state_t;
+typedef enum { RUNNING, STOPPED, QUEUED, WAITING, CANCELLED } process_state_t;
 
 typedef struct job_list job_list_t;
 
@@ -21,6 +21,50 @@ void cleanup_job_list(job_list_t *job_list);
 int add_job(job_list_t *job_list, int jid, pid_t pid, process_state_t state,
             char *command);
 
+/*
+ * adds a job that has not been started yet to the end of the list, in the
+ * QUEUED state and without a PID, returns 0 on success, -1 on failure
+ * data is whatever the caller needs to start the job later on, the list only
+ * holds on to it and never frees it
+ */
+int queue_job(job_list_t *job_list, int jid, char *command, void *data);
+/*
+ * marks a job that has not been started yet as RUNNING once its process has
+ * been started, given the job's JID, returns 0 on success, -1 on failure
+ */
+int start_job(job_list_t *job_list, int jid, pid_t pid);
+/*
+ * gets JID of the first job in the list in the given state, which is the
+ * oldest one as jobs are added at the tail, returns -1 if there is none
+ */
+int find_job_jid(job_list_t *job_list, process_state_t state);
+/*
+ * gets data of a job that has not been started yet, given job's JID,
+ * returns NULL on failure
+ */
+void *get_queued_data(job_list_t *job_list, int jid);
+/*
+ * makes a queued job wait for the jobs with the given JIDs to finish, and
+ * with require_success for each of them to exit with status 0 as well,
+ * returns the number of jobs it waits for on success, -1 on failure
+ * The job is WAITING until then, unless none of the JIDs are in the list, as
+ * those jobs have finished already. It is CANCELLED right away, to be
+ * removed by the caller, if it requires success and one of those failed, as
+ * release_jobs records how every job ended.
+ */
+int add_job_dependencies(job_list_t *job_list, int jid, int after[],
+                         int count, int require_success);
+/*
+ * releases the jobs waiting for the job with the given JID once it has
+ * finished, with success set if it exited with status 0. Jobs that waited
+ * for nothing else are QUEUED, and those that required it to succeed when
+ * it did not are CANCELLED, to be removed by the caller. How the job ended
+ * is kept for jobs that are made to wait for it later on.
+ */
+void release_jobs(job_list_t *job_list, int jid, int success);
+/* returns the number of jobs in the list in the given state */
+int count_jobs(job_list_t *job_list, process_state_t state);
+
 /* removes job from list, given job's JID,
         returns 0 on success, -1 on failure */
 int remove_job_jid(job_list_t *job_list, int jid);
@@ -33,7 +77,10 @@ int update_job_jid(job_list_t *job_list, int jid, process_state_t state);
 /* updates job's state, given job's PID, returns 0 on success, -1 on failure */
 int update_job_pid(job_list_t *job_list, pid_t pid, process_state_t state);
 
-/* gets PID of job, given job's JID, returns PID on success, -1 on failure */
+/*
+ * gets PID of job, given job's JID, returns PID on success, 0 if the job is
+ * still queued, -1 on failure
+ */
 pid_t get_job_pid(job_list_t *job_list, int jid);
 /* gets JID of job, given job's PID, returns JID on success, -1 on failure */
 int get_job_jid(job_list_t *job_list, pid_t pid);
@@ -46,7 +93,37 @@ int get_job_jid(job_list_t *job_list, pid_t pid);
  */
 pid_t get_next_pid(job_list_t *job_list);
 
+/*
+ * returns 1 if there are any jobs in the list or helper processes that have
+ * not been reaped yet, 0 otherwise
+ */
+int has_jobs(job_list_t *job_list);
+
+/*
+ * adds a helper process started for the job with the given JID, or for a
+ * foreground command when jid is 0, returns 0 on success, -1 on failure
+ * Helpers, such as the commands behind a process substitution, are not jobs of
+ * their own, they are only reaped along with the job, and those of background
+ * jobs are killed when the shell's job list is cleaned up.
+ */
+int add_job_helper(job_list_t *job_list, int jid, pid_t pid);
+/*
+ * removes a helper process once it has been reaped, given its PID
+ * returns the JID it was started for on success, -1 if it is not a helper
+ */
+int remove_job_helper(job_list_t *job_list, pid_t pid);
+
 /* jobs command, prints out the jobs list */
 void jobs(job_list_t *job_list);
+/*
+ * jobs -s command, prints the state, CPU usage and resident memory of every
+ * job with a process, as read from its /proc/<pid>/stat and statm. The files
+ * are kept open at MIN_SHELL_FD or above from one call to the next and read
+ * again with pread, until the job is removed. The CPU usage is taken since
+ * the previous call, or over the whole life of a job sampled for the first
+ * time.
+ * returns 0 on success, -1 on failure
+ */
+int job_stats(job_list_t *job_list);
 
 #endif  // JOBS_H_
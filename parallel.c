@@ -0,0 +1,446 @@
+#include "./parallel.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A worker slot, which runs one command at a time. A slot is busy until its
+// command has been reaped and, with --tag, its output pipe has been read to
+// the end, whichever comes last.
+typedef struct slot {
+    // process of the command, 0 once it has been reaped
+    pid_t pid;
+    // pidfd of the command, readable once it has exited
+    int pidfd;
+    // read end of the command's output pipe with --tag, -1 otherwise
+    int out_fd;
+    const char *input;
+    // tagged output that has not been ended by a newline yet
+    char *line;
+    size_t line_length;
+    size_t line_capacity;
+} slot_t;
+
+/* returns 1 if slot still has a command or output to wait for */
+static int slot_busy(const slot_t *slot) {
+    return slot->pid != 0 || slot->out_fd != -1;
+}
+
+/*
+ * reads standard input and splits it into lines, which are stored in lines,
+ * returns the number of lines, or -1 on failure
+ * Note: the text the lines point to is returned in text, free it and lines
+ */
+static int read_lines(char **text, char ***lines) {
+    size_t length = 0;
+    size_t capacity = 4096;
+    char *buffer = (char *)malloc(capacity + 1);
+    if (buffer == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    while (1) {
+        if (length == capacity) {
+            capacity *= 2;
+            char *grown = (char *)realloc(buffer, capacity + 1);
+            if (grown == NULL) {
+                perror("realloc");
+                free(buffer);
+                return -1;
+            }
+            buffer = grown;
+        }
+        ssize_t bytes_read = read(0, buffer + length, capacity - length);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read == -1) {
+            perror("parallel: read");
+            free(buffer);
+            return -1;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        length += (size_t)bytes_read;
+    }
+    // The last line does not need a newline of its own
+    if (length > 0 && buffer[length - 1] != '\n') {
+        buffer[length++] = '\n';
+    }
+
+    int count = 0;
+    for (size_t i = 0; i < length; i++) {
+        count += buffer[i] == '\n';
+    }
+    *lines = (char **)malloc(sizeof(char *) * (size_t)(count + 1));
+    if (*lines == NULL) {
+        perror("malloc");
+        free(buffer);
+        return -1;
+    }
+    char *start = buffer;
+    for (int i = 0; i < count; i++) {
+        char *end = memchr(start, '\n', length - (size_t)(start - buffer));
+        *end = '\0';
+        (*lines)[i] = start;
+        start = end + 1;
+    }
+    *text = buffer;
+    return count;
+}
+
+/*
+ * replaces every {} in word with input, returns the new word, which is
+ * malloced if it differs from word, or NULL if memory ran out
+ */
+static char *replace_braces(char *word, const char *input) {
+    size_t count = 0;
+    for (char *brace = strstr(word, "{}"); brace != NULL;
+         brace = strstr(brace + 2, "{}")) {
+        count++;
+    }
+    if (count == 0) {
+        return word;
+    }
+    size_t input_length = strlen(input);
+    char *replaced =
+        (char *)malloc(strlen(word) + count * input_length - 2 * count + 1);
+    if (replaced == NULL) {
+        return NULL;
+    }
+    char *out = replaced;
+    char *brace;
+    while ((brace = strstr(word, "{}")) != NULL) {
+        memcpy(out, word, (size_t)(brace - word));
+        out += brace - word;
+        memcpy(out, input, input_length);
+        out += input_length;
+        word = brace + 2;
+    }
+    strcpy(out, word);
+    return replaced;
+}
+
+/*
+ * builds the argument vector of the command for one input, returns NULL if
+ * memory ran out
+ * Note: only called in the child, which never frees it
+ */
+static char **build_argv(char *command[], int command_count, char *input) {
+    char **argv = (char **)malloc(sizeof(char *) * (size_t)(command_count + 2));
+    if (argv == NULL) {
+        return NULL;
+    }
+    int replaced = 0;
+    for (int i = 0; i < command_count; i++) {
+        if ((argv[i] = replace_braces(command[i], input)) == NULL) {
+            return NULL;
+        }
+        replaced |= argv[i] != command[i];
+    }
+    argv[command_count] = replaced ? NULL : input;
+    argv[command_count + 1] = NULL;
+    return argv;
+}
+
+/*
+ * starts the command for input in slot, returns 0 on success, -1 on failure
+ * The command's standard output goes to a pipe with tag, and its standard
+ * input is /dev/null when the inputs were read from the shell's.
+ */
+static int start_slot(slot_t *slot, char *command[], int command_count,
+                      char *input, int tag, int null_stdin,
+                      job_runner_t runner) {
+    int fds[2] = {-1, -1};
+    if (tag && pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        return -1;
+    }
+    // Output buffered by the shell must not be written by the child as well
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        if (tag && dup2(fds[1], 1) == -1) {
+            perror("dup2");
+            exit(1);
+        }
+        if (null_stdin) {
+            int null_fd = open("/dev/null", O_RDONLY);
+            if (null_fd == -1 || dup2(null_fd, 0) == -1) {
+                perror("/dev/null");
+                exit(1);
+            }
+            close(null_fd);
+        }
+        char **argv = build_argv(command, command_count, input);
+        if (argv == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        runner(argv);
+        exit(127);
+    }
+    if (tag) {
+        close(fds[1]);
+    }
+
+    int pidfd = pidfd_open(pid, 0);
+    if (pidfd == -1) {
+        perror("pidfd_open");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(fds[0]);
+        return -1;
+    }
+    slot->pid = pid;
+    slot->pidfd = pidfd;
+    slot->out_fd = fds[0];
+    slot->input = input;
+    slot->line_length = 0;
+    return 0;
+}
+
+/* writes the complete lines in slot's output, or all of it when at_eof */
+static void flush_lines(slot_t *slot, int at_eof) {
+    size_t start = 0;
+    while (start < slot->line_length) {
+        char *newline =
+            memchr(slot->line + start, '\n', slot->line_length - start);
+        if (newline == NULL && !at_eof) {
+            break;
+        }
+        size_t end = newline != NULL ? (size_t)(newline - slot->line)
+                                     : slot->line_length;
+        printf("%s\t%.*s\n", slot->input, (int)(end - start),
+               slot->line + start);
+        start = end + 1;
+    }
+    if (start >= slot->line_length) {
+        slot->line_length = 0;
+    } else {
+        memmove(slot->line, slot->line + start, slot->line_length - start);
+        slot->line_length -= start;
+    }
+}
+
+/*
+ * reads what is available on slot's output pipe and writes out the lines it
+ * completes, closing the pipe at its end
+ */
+static void read_output(slot_t *slot) {
+    if (slot->line_capacity - slot->line_length < 4096) {
+        size_t capacity = 2 * slot->line_capacity + 4096;
+        char *grown = (char *)realloc(slot->line, capacity);
+        if (grown == NULL) {
+            perror("realloc");
+            return;
+        }
+        slot->line = grown;
+        slot->line_capacity = capacity;
+    }
+    ssize_t bytes_read = read(slot->out_fd, slot->line + slot->line_length,
+                              slot->line_capacity - slot->line_length);
+    if (bytes_read == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (bytes_read <= 0) {
+        flush_lines(slot, 1);
+        close(slot->out_fd);
+        slot->out_fd = -1;
+        return;
+    }
+    slot->line_length += (size_t)bytes_read;
+    flush_lines(slot, 0);
+}
+
+/*
+ * parallel [-j count] [--tag] command [args] [::: inputs]
+ * runs command once for each input, with at most count commands at once
+ * returns 0 if every command succeeded, otherwise the number of commands
+ * that failed, or 101 if more than 100 did, and 255 on a usage error
+ */
+int parallel(char *argv[], int argc, job_runner_t runner) {
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int tag = 0;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        char *end;
+        if (strcmp(argv[arg], "--tag") == 0) {
+            tag = 1;
+        } else if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+            jobs = strtol(argv[++arg], &end, 10);
+            if (*argv[arg] == '\0' || *end != '\0' || jobs < 1) {
+                fprintf(stderr, "parallel: %s: invalid job count\n", argv[arg]);
+                return 255;
+            }
+        } else if (strncmp(argv[arg], "-j", 2) == 0 && argv[arg][2] != '\0') {
+            jobs = strtol(argv[arg] + 2, &end, 10);
+            if (*end != '\0' || jobs < 1) {
+                fprintf(stderr, "parallel: %s: invalid job count\n",
+                        argv[arg] + 2);
+                return 255;
+            }
+        } else if (strcmp(argv[arg], "--") == 0) {
+            arg++;
+            break;
+        } else {
+            fprintf(stderr, "parallel: %s: invalid option\n", argv[arg]);
+            return 255;
+        }
+    }
+    // The command runs up to the ::: that starts the inputs, if there is one
+    char **command = argv + arg;
+    int command_count = 0;
+    while (arg + command_count < argc &&
+           strcmp(argv[arg + command_count], ":::") != 0) {
+        command_count++;
+    }
+    if (command_count == 0) {
+        fprintf(stderr,
+                "parallel: usage: parallel [-j count] [--tag] command "
+                "[args] [::: inputs]\n");
+        return 255;
+    }
+
+    char *text = NULL;
+    char **inputs;
+    int input_count;
+    int from_stdin = arg + command_count == argc;
+    if (from_stdin) {
+        if ((input_count = read_lines(&text, &inputs)) == -1) {
+            return 255;
+        }
+    } else {
+        inputs = argv + arg + command_count + 1;
+        input_count = argc - (arg + command_count + 1);
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    if (jobs > input_count) {
+        jobs = input_count;
+    }
+
+    slot_t *slots = (slot_t *)calloc((size_t)jobs + 1, sizeof(slot_t));
+    struct pollfd *fds =
+        (struct pollfd *)malloc(sizeof(struct pollfd) * (size_t)(2 * jobs + 1));
+    if (slots == NULL || fds == NULL) {
+        perror("malloc");
+        free(slots);
+        free(fds);
+        if (from_stdin) {
+            free(inputs);
+            free(text);
+        }
+        return 255;
+    }
+    for (long i = 0; i < jobs; i++) {
+        slots[i].out_fd = -1;
+    }
+
+    int next = 0;
+    int busy = 0;
+    int failed = 0;
+    while (next < input_count || busy > 0) {
+        // Fill the free slots, and stop starting commands once one fails
+        // to start at all or is interrupted
+        for (long i = 0; i < jobs && next < input_count; i++) {
+            if (slot_busy(&slots[i])) {
+                continue;
+            }
+            if (start_slot(&slots[i], command, command_count, inputs[next],
+                           tag, from_stdin, runner) == -1) {
+                failed += input_count - next;
+                next = input_count;
+                break;
+            }
+            next++;
+            busy++;
+        }
+        if (busy == 0) {
+            break;
+        }
+
+        // Wait on the exits and the output of every busy slot at once,
+        // fds holds two entries per slot so they map back by index
+        for (long i = 0; i < jobs; i++) {
+            fds[2 * i].fd = slots[i].pid != 0 ? slots[i].pidfd : -1;
+            fds[2 * i].events = POLLIN;
+            fds[2 * i].revents = 0;
+            fds[2 * i + 1].fd = slots[i].out_fd;
+            fds[2 * i + 1].events = POLLIN;
+            fds[2 * i + 1].revents = 0;
+        }
+        if (poll(fds, (nfds_t)(2 * jobs), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        for (long i = 0; i < jobs; i++) {
+            slot_t *slot = &slots[i];
+            if (fds[2 * i + 1].revents != 0) {
+                read_output(slot);
+            }
+            if (fds[2 * i].revents != 0) {
+                int status;
+                if (waitpid(slot->pid, &status, 0) == -1) {
+                    perror("waitpid");
+                    status = 1;
+                }
+                failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+                // A command interrupted from the keyboard stops the rest
+                // from starting, just like one that failed to start
+                if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+                    failed += input_count - next;
+                    next = input_count;
+                }
+                close(slot->pidfd);
+                slot->pid = 0;
+            }
+            if (!slot_busy(slot) && (fds[2 * i].revents != 0 ||
+                                     fds[2 * i + 1].revents != 0)) {
+                busy--;
+            }
+        }
+    }
+    fflush(stdout);
+
+    // Commands still running after a failure are left to finish
+    for (long i = 0; i < jobs; i++) {
+        if (slots[i].pid != 0) {
+            waitpid(slots[i].pid, NULL, 0);
+            close(slots[i].pidfd);
+        }
+        if (slots[i].out_fd != -1) {
+            close(slots[i].out_fd);
+        }
+        free(slots[i].line);
+    }
+    free(slots);
+    free(fds);
+    if (from_stdin) {
+        free(inputs);
+        free(text);
+    }
+
+    if (failed > 0) {
+        fprintf(stderr, "parallel: %d of %d jobs failed\n", failed,
+                input_count);
+    }
+    return failed > 100 ? 101 : failed;
+}
@@ -0,0 +1,26 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+/*
+ * Runs the command of one parallel job in the child forked for it, given the
+ * argument vector built for its input. Never returns.
+ */
+typedef void (*job_runner_t)(char *argv[]);
+
+/*
+ * parallel [-j count] [--tag] command [args] [::: inputs]
+ * runs command once for each input, with every {} in its words replaced by
+ * the input, or the input added as the last argument if there is no {}.
+ * Inputs are the words after ::: or, without them, the lines of standard
+ * input, in which case the commands read /dev/null instead. At most count
+ * commands, the number of online CPUs by default, run at once, each started
+ * through runner as soon as an earlier one has finished. With --tag each
+ * line a command writes to standard output is passed on prefixed by its input
+ * and a tab, so the output of commands running side by side is never mixed
+ * within a line.
+ * returns 0 if every command succeeded, otherwise the number of commands
+ * that failed, or 101 if more than 100 did, and 255 on a usage error
+ */
+int parallel(char *argv[], int argc, job_runner_t runner);
+
+#endif  // PARALLEL_H_
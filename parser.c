@@ -0,0 +1,911 @@
+#include "./parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./vars.h"
+
+typedef enum {
+    TOKEN_WORD,
+    TOKEN_NEWLINE,
+    TOKEN_SEMI,
+    TOKEN_AMP,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_LESS,
+    TOKEN_GREAT,
+    TOKEN_DGREAT,
+    TOKEN_LESSGREAT,
+    TOKEN_LESSAND,
+    TOKEN_GREATAND,
+    TOKEN_AMPGREAT,
+    TOKEN_AMPDGREAT,
+    TOKEN_DLESS,
+    TOKEN_DLESSDASH,
+    TOKEN_TLESS,
+    // digits written right before a redirection operator, as in 2>
+    TOKEN_IO_NUMBER,
+    TOKEN_EOF
+} token_type_t;
+
+// text points into the source and is not NUL terminated
+typedef struct token {
+    token_type_t type;
+    const char *text;
+    size_t length;
+} token_t;
+
+// pos is the position just after the current lookahead token
+// incomplete and error stop the parse, incomplete when the text ran out
+// heredoc_end is where the bodies of the current line's here-documents end,
+// or 0 if the line has none, the newline ending the line skips to it
+typedef struct parse_state {
+    parser_t *parser;
+    size_t pos;
+    token_t token;
+    int incomplete;
+    int error;
+    size_t heredoc_end;
+} parse_state_t;
+
+static node_t *parse_and_or(parse_state_t *state);
+static node_t *parse_compound_list(parse_state_t *state);
+
+/* returns 1 if c ends a word */
+static int is_metachar(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '&' ||
+           c == '<' || c == '>';
+}
+
+/*
+ * skips over a parenthesized group starting at the '(' at pos, returns the
+ * position after its closing ')' or the end of the text if it is unclosed
+ */
+static size_t skip_parens(parse_state_t *state, size_t pos) {
+    const char *src = state->parser->src;
+    size_t length = state->parser->length;
+    int depth = 0;
+    for (; pos < length; pos++) {
+        if (src[pos] == '(') {
+            depth++;
+        } else if (src[pos] == ')' && --depth == 0) {
+            return pos + 1;
+        }
+    }
+    // More text may still close the group
+    if (!state->parser->at_eof) {
+        state->incomplete = 1;
+    }
+    return length;
+}
+
+/* reads the next token into state->token */
+static void advance(parse_state_t *state) {
+    const char *src = state->parser->src;
+    size_t length = state->parser->length;
+    size_t pos = state->pos;
+
+    // Skip blanks and comments, but not the newline that ends a comment
+    while (pos < length) {
+        if (src[pos] == ' ' || src[pos] == '\t') {
+            pos++;
+        } else if (src[pos] == '#') {
+            while (pos < length && src[pos] != '\n') {
+                pos++;
+            }
+        } else {
+            break;
+        }
+    }
+
+    // <( ) and >( ) start a word holding a process substitution rather than
+    // a redirection
+    int substitution = pos + 1 < length &&
+                       (src[pos] == '<' || src[pos] == '>') &&
+                       src[pos + 1] == '(';
+
+    token_t *token = &state->token;
+    token->text = src + pos;
+    token->length = 1;
+    if (pos >= length) {
+        token->type = TOKEN_EOF;
+        token->length = 0;
+    } else if (src[pos] == '\n') {
+        token->type = TOKEN_NEWLINE;
+    } else if (src[pos] == ';') {
+        token->type = TOKEN_SEMI;
+    } else if (src[pos] == '&') {
+        token->type = TOKEN_AMP;
+        if (pos + 1 < length && src[pos + 1] == '&') {
+            token->type = TOKEN_AND;
+            token->length = 2;
+        } else if (pos + 2 < length && src[pos + 1] == '>' &&
+                   src[pos + 2] == '>') {
+            token->type = TOKEN_AMPDGREAT;
+            token->length = 3;
+        } else if (pos + 1 < length && src[pos + 1] == '>') {
+            token->type = TOKEN_AMPGREAT;
+            token->length = 2;
+        }
+    } else if (src[pos] == '|' && pos + 1 < length && src[pos + 1] == '|') {
+        token->type = TOKEN_OR;
+        token->length = 2;
+    } else if (src[pos] == '<' && !substitution) {
+        token->type = TOKEN_LESS;
+        if (pos + 2 < length && src[pos + 1] == '<' && src[pos + 2] == '<') {
+            token->type = TOKEN_TLESS;
+            token->length = 3;
+        } else if (pos + 2 < length && src[pos + 1] == '<' &&
+                   src[pos + 2] == '-') {
+            token->type = TOKEN_DLESSDASH;
+            token->length = 3;
+        } else if (pos + 1 < length && src[pos + 1] == '<') {
+            token->type = TOKEN_DLESS;
+            token->length = 2;
+        } else if (pos + 1 < length && src[pos + 1] == '>') {
+            token->type = TOKEN_LESSGREAT;
+            token->length = 2;
+        } else if (pos + 1 < length && src[pos + 1] == '&') {
+            token->type = TOKEN_LESSAND;
+            token->length = 2;
+        }
+    } else if (src[pos] == '>' && !substitution) {
+        token->type = TOKEN_GREAT;
+        if (pos + 1 < length && src[pos + 1] == '>') {
+            token->type = TOKEN_DGREAT;
+            token->length = 2;
+        } else if (pos + 1 < length && src[pos + 1] == '&') {
+            token->type = TOKEN_GREATAND;
+            token->length = 2;
+        }
+    } else {
+        // A word runs up to the next metacharacter, except that $( ) groups
+        // are kept whole even if they contain blanks
+        size_t end = substitution ? skip_parens(state, pos + 1) : pos;
+        while (end < length && !is_metachar(src[end]) &&
+               !(src[end] == '|' && end + 1 < length && src[end + 1] == '|')) {
+            if (src[end] == '$' && end + 1 < length && src[end + 1] == '(') {
+                end = skip_parens(state, end + 1);
+            } else {
+                end++;
+            }
+        }
+        token->type = TOKEN_WORD;
+        token->length = end - pos;
+        // A number written right against < or > names the descriptor
+        size_t digits = pos;
+        while (digits < end && src[digits] >= '0' && src[digits] <= '9') {
+            digits++;
+        }
+        if (digits == end && end < length &&
+            (src[end] == '<' || src[end] == '>')) {
+            token->type = TOKEN_IO_NUMBER;
+        }
+    }
+    state->pos = pos + token->length;
+    // The here-document bodies after a line are not part of its commands
+    if (token->type == TOKEN_NEWLINE && state->heredoc_end > pos) {
+        state->pos = state->heredoc_end;
+        state->heredoc_end = 0;
+    }
+}
+
+/* returns 1 if the token type is a redirection operator */
+static int is_redirect_op(token_type_t type) {
+    return type == TOKEN_LESS || type == TOKEN_GREAT || type == TOKEN_DGREAT ||
+           type == TOKEN_LESSGREAT || type == TOKEN_LESSAND ||
+           type == TOKEN_GREATAND || type == TOKEN_AMPGREAT ||
+           type == TOKEN_AMPDGREAT || type == TOKEN_DLESS ||
+           type == TOKEN_DLESSDASH || type == TOKEN_TLESS;
+}
+
+/* returns 1 if the current token is the given word */
+static int is_word(parse_state_t *state, const char *word) {
+    return state->token.type == TOKEN_WORD &&
+           state->token.length == strlen(word) &&
+           strncmp(state->token.text, word, state->token.length) == 0;
+}
+
+/* returns 1 if the current token is a reserved word that ends a list */
+static int is_terminator(parse_state_t *state) {
+    const char *terminators[] = {"then", "elif", "else", "fi",
+                                 "do",   "done", "}"};
+    for (size_t i = 0; i < sizeof(terminators) / sizeof(terminators[0]);
+         i++) {
+        if (is_word(state, terminators[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * marks the parse as incomplete if the text ran out while more of the
+ * command can still arrive, returns 1 if it did
+ */
+static int needs_more(parse_state_t *state) {
+    if (state->token.type == TOKEN_EOF && !state->parser->at_eof) {
+        state->incomplete = 1;
+    }
+    return state->incomplete;
+}
+
+/* reports a syntax error once, unless the parse is only incomplete */
+static void syntax_error(parse_state_t *state, const char *msg) {
+    if (!state->error && !needs_more(state)) {
+        fprintf(stderr, "%s\n", msg);
+        state->error = 1;
+    }
+}
+
+/* reports a syntax error naming the current token */
+static void unexpected_token(parse_state_t *state) {
+    if (state->error || needs_more(state)) {
+        return;
+    }
+    if (state->token.type == TOKEN_EOF) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+    } else if (state->token.type == TOKEN_NEWLINE) {
+        fprintf(stderr, "syntax error near unexpected token `newline'\n");
+    } else {
+        fprintf(stderr, "syntax error near unexpected token `%.*s'\n",
+                (int)state->token.length, state->token.text);
+    }
+    state->error = 1;
+}
+
+/* skips newlines between the commands of a list */
+static void skip_newlines(parse_state_t *state) {
+    while (state->token.type == TOKEN_NEWLINE) {
+        advance(state);
+    }
+}
+
+/* consumes the reserved word that closes a construct, returns 1 if found */
+static int expect_word(parse_state_t *state, const char *word) {
+    if (!is_word(state, word)) {
+        unexpected_token(state);
+        return 0;
+    }
+    advance(state);
+    return 1;
+}
+
+/* copies the current token out of the source text */
+static char *token_string(parse_state_t *state) {
+    return strndup(state->token.text, state->token.length);
+}
+
+/* allocates an empty node of the given type */
+static node_t *new_node(node_type_t type) {
+    node_t *node = (node_t *)calloc(1, sizeof(node_t));
+    if (node == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    node->type = type;
+    return node;
+}
+
+/* appends a copy of the current token to a NULL terminated word array */
+static void append_word(parse_state_t *state, char ***words, int *count) {
+    char **grown =
+        (char **)realloc(*words, (size_t)(*count + 2) * sizeof(char *));
+    if (grown == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    grown[*count] = token_string(state);
+    grown[*count + 1] = NULL;
+    *words = grown;
+    (*count)++;
+}
+
+/* appends a redirection to a command, taking ownership of target */
+static void add_redirect(node_t *node, redirect_type_t type, int fd,
+                         char *target) {
+    redirect_t *grown = (redirect_t *)realloc(
+        node->redirects, (size_t)(node->redirect_count + 1) * sizeof(redirect_t));
+    if (grown == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    grown[node->redirect_count].type = type;
+    grown[node->redirect_count].fd = fd;
+    grown[node->redirect_count].target = target;
+    node->redirects = grown;
+    node->redirect_count++;
+}
+
+/* returns 1 if a plain < or > (or >>) already redirects fd in node */
+static int has_file_redirect(node_t *node, int fd, int input) {
+    for (int i = 0; i < node->redirect_count; i++) {
+        redirect_type_t type = node->redirects[i].type;
+        if (node->redirects[i].fd == fd &&
+            (input ? type == REDIRECT_INPUT
+                   : type == REDIRECT_OUTPUT || type == REDIRECT_APPEND)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* returns 1 if the string is a descriptor number or - */
+static int is_dup_target(const char *target) {
+    if (strcmp(target, "-") == 0) {
+        return 1;
+    }
+    for (; *target != '\0'; target++) {
+        if (*target < '0' || *target > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* appends characters to a growable string, keeping it NUL terminated */
+static void append_text(char **text, size_t *length, size_t *capacity,
+                        const char *src, size_t count) {
+    if (*length + count + 1 > *capacity) {
+        *capacity = 2 * (*length + count + 1);
+        char *grown = (char *)realloc(*text, *capacity);
+        if (grown == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        *text = grown;
+    }
+    memcpy(*text + *length, src, count);
+    *length += count;
+    (*text)[*length] = '\0';
+}
+
+/*
+ * reads the body of a here-document, which starts on the line after the
+ * command, or after the body of the line's previous here-document, and runs
+ * up to a line holding only the delimiter. Quotes in the delimiter are
+ * removed and strip_tabs removes leading tabs from every line, as for <<-.
+ * returns the body, or NULL if the text ran out before the delimiter
+ */
+static char *read_heredoc(parse_state_t *state, char *delimiter,
+                          int strip_tabs) {
+    const char *src = state->parser->src;
+    size_t length = state->parser->length;
+    size_t pos = state->heredoc_end;
+    char *body = NULL;
+    size_t body_length = 0;
+    size_t capacity = 0;
+
+    char *quote;
+    while ((quote = strpbrk(delimiter, "'\"")) != NULL) {
+        memmove(quote, quote + 1, strlen(quote));
+    }
+    size_t delimiter_length = strlen(delimiter);
+    if (pos == 0) {
+        pos = state->pos;
+        while (pos < length && src[pos] != '\n') {
+            pos++;
+        }
+        if (pos < length) {
+            pos++;
+        }
+    }
+    append_text(&body, &body_length, &capacity, "", 0);
+    while (1) {
+        size_t end = pos;
+        while (end < length && src[end] != '\n') {
+            end++;
+        }
+        // Wait until the whole line is there, unless no more text can follow
+        if (end >= length && !state->parser->at_eof) {
+            state->incomplete = 1;
+            free(body);
+            return NULL;
+        }
+        if (pos >= length) {
+            break;
+        }
+        size_t line = pos;
+        while (strip_tabs && line < end && src[line] == '\t') {
+            line++;
+        }
+        pos = end < length ? end + 1 : end;
+        if (end - line == delimiter_length &&
+            strncmp(src + line, delimiter, delimiter_length) == 0) {
+            break;
+        }
+        append_text(&body, &body_length, &capacity, src + line,
+                    pos - line);
+    }
+    state->heredoc_end = pos;
+    return body;
+}
+
+/*
+ * parses one redirection, starting at an optional descriptor number,
+ * returns 0 on success and -1 after reporting a syntax error
+ */
+static int parse_redirect(parse_state_t *state, node_t *node) {
+    int fd = -1;
+    if (state->token.type == TOKEN_IO_NUMBER) {
+        fd = atoi(state->token.text);
+        advance(state);
+    }
+    token_type_t type = state->token.type;
+    int input = type == TOKEN_LESS || type == TOKEN_LESSGREAT ||
+                type == TOKEN_LESSAND || type == TOKEN_DLESS ||
+                type == TOKEN_DLESSDASH || type == TOKEN_TLESS;
+    if (fd == -1) {
+        fd = input ? 0 : 1;
+    }
+    // A command may only read one file or write one file through < and >
+    if (type == TOKEN_LESS && has_file_redirect(node, fd, 1)) {
+        syntax_error(state, "syntax error: multiple input files");
+        return -1;
+    } else if ((type == TOKEN_GREAT || type == TOKEN_DGREAT ||
+                type == TOKEN_AMPGREAT || type == TOKEN_AMPDGREAT) &&
+               has_file_redirect(node, fd, 0)) {
+        syntax_error(state, "syntax error: mulitple output files");
+        return -1;
+    }
+    if (node->redirect_count + 2 > MAX_REDIRECTS) {
+        syntax_error(state, "syntax error: too many redirections");
+        return -1;
+    }
+    advance(state);
+    if (is_redirect_op(state->token.type) ||
+        state->token.type == TOKEN_IO_NUMBER) {
+        syntax_error(state, input ? "syntax error: input file is a "
+                                    "redirection symbol"
+                                  : "syntax error: output file is a "
+                                    "redirection symbol");
+        return -1;
+    } else if (state->token.type != TOKEN_WORD) {
+        syntax_error(state, input ? "syntax error: no input file"
+                                  : "syntax error: no output file");
+        return -1;
+    }
+    char *target = token_string(state);
+    // A here-document's body has to be found before the newline after it is
+    // read, so that reading the newline can skip over the body
+    char *body = NULL;
+    int quoted = 0;
+    if (type == TOKEN_DLESS || type == TOKEN_DLESSDASH) {
+        // Quotes around the delimiter turn off expansion of the body
+        quoted = strpbrk(target, "'\"") != NULL;
+        body = read_heredoc(state, target, type == TOKEN_DLESSDASH);
+        free(target);
+        if (body == NULL) {
+            return -1;
+        }
+    }
+    advance(state);
+    switch (type) {
+        case TOKEN_LESS:
+            add_redirect(node, REDIRECT_INPUT, fd, target);
+            break;
+        case TOKEN_GREAT:
+            add_redirect(node, REDIRECT_OUTPUT, fd, target);
+            break;
+        case TOKEN_DGREAT:
+            add_redirect(node, REDIRECT_APPEND, fd, target);
+            break;
+        case TOKEN_LESSGREAT:
+            add_redirect(node, REDIRECT_READ_WRITE, fd, target);
+            break;
+        case TOKEN_TLESS:
+            add_redirect(node, REDIRECT_HERESTRING, fd, target);
+            break;
+        case TOKEN_DLESS:
+        case TOKEN_DLESSDASH:
+            add_redirect(node,
+                         quoted ? REDIRECT_HEREDOC_QUOTED : REDIRECT_HEREDOC,
+                         fd, body);
+            break;
+        case TOKEN_LESSAND:
+        case TOKEN_GREATAND:
+            // >&file with no descriptor number is another way to write &>
+            if (is_dup_target(target) || type == TOKEN_LESSAND) {
+                add_redirect(node, REDIRECT_DUP, fd, target);
+                break;
+            }
+            add_redirect(node, REDIRECT_OUTPUT, fd, target);
+            add_redirect(node, REDIRECT_DUP, 2, strdup("1"));
+            break;
+        default:
+            // &> and &>> send both standard output and standard error
+            add_redirect(node,
+                         type == TOKEN_AMPGREAT ? REDIRECT_OUTPUT
+                                                : REDIRECT_APPEND,
+                         1, target);
+            add_redirect(node, REDIRECT_DUP, 2, strdup("1"));
+            break;
+    }
+    return 0;
+}
+
+/* parses the words and redirections of a simple command */
+static node_t *parse_simple_command(parse_state_t *state) {
+    node_t *node = new_node(NODE_COMMAND);
+    while (!state->error && !state->incomplete) {
+        token_type_t type = state->token.type;
+        if (type == TOKEN_WORD) {
+            append_word(state, &node->words, &node->word_count);
+            advance(state);
+        } else if (type == TOKEN_IO_NUMBER || is_redirect_op(type)) {
+            if (parse_redirect(state, node) == -1) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+    if (!state->error && !state->incomplete && node->word_count == 0 &&
+        node->redirect_count > 0) {
+        syntax_error(state, "error:redirects with no command");
+    }
+    if (state->error || state->incomplete) {
+        free_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+/* parses if/elif, with the reserved word already consumed, up to its fi */
+static node_t *parse_if(parse_state_t *state) {
+    node_t *node = new_node(NODE_IF);
+    node->condition = parse_compound_list(state);
+    if (node->condition != NULL && expect_word(state, "then")) {
+        node->body = parse_compound_list(state);
+    }
+    if (node->body != NULL) {
+        if (is_word(state, "elif")) {
+            advance(state);
+            node->else_body = parse_if(state);
+            // The nested if already consumed the shared fi
+            if (node->else_body != NULL) {
+                return node;
+            }
+        } else if (is_word(state, "else")) {
+            advance(state);
+            node->else_body = parse_compound_list(state);
+            if (node->else_body != NULL) {
+                expect_word(state, "fi");
+            }
+        } else {
+            expect_word(state, "fi");
+        }
+    }
+    if (state->error || state->incomplete) {
+        free_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+/* parses a while loop, with the reserved word already consumed */
+static node_t *parse_while(parse_state_t *state) {
+    node_t *node = new_node(NODE_WHILE);
+    node->condition = parse_compound_list(state);
+    if (node->condition != NULL && expect_word(state, "do")) {
+        node->body = parse_compound_list(state);
+        if (node->body != NULL) {
+            expect_word(state, "done");
+        }
+    }
+    if (state->error || state->incomplete) {
+        free_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+/* parses a for loop, with the reserved word already consumed */
+static node_t *parse_for(parse_state_t *state) {
+    node_t *node = new_node(NODE_FOR);
+    if (state->token.type != TOKEN_WORD) {
+        unexpected_token(state);
+    } else {
+        node->name = token_string(state);
+        advance(state);
+        skip_newlines(state);
+        if (is_word(state, "in")) {
+            advance(state);
+            // An empty list still loops over nothing rather than over $@
+            node->words = (char **)calloc(1, sizeof(char *));
+            while (state->token.type == TOKEN_WORD) {
+                append_word(state, &node->words, &node->word_count);
+                advance(state);
+            }
+            if (state->token.type == TOKEN_SEMI ||
+                state->token.type == TOKEN_NEWLINE) {
+                advance(state);
+            } else {
+                unexpected_token(state);
+            }
+        } else if (state->token.type == TOKEN_SEMI) {
+            advance(state);
+        }
+        skip_newlines(state);
+        if (!state->error && expect_word(state, "do")) {
+            node->body = parse_compound_list(state);
+            if (node->body != NULL) {
+                expect_word(state, "done");
+            }
+        }
+    }
+    if (state->error || state->incomplete) {
+        free_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+/* parses a { list; } group, with the opening brace already consumed */
+static node_t *parse_group(parse_state_t *state) {
+    node_t *node = new_node(NODE_GROUP);
+    node->body = parse_compound_list(state);
+    if (node->body != NULL) {
+        expect_word(state, "}");
+    }
+    if (state->error || state->incomplete) {
+        free_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+/*
+ * checks for the start of a function definition, written name() or name (),
+ * and consumes it. Returns the function's name, or NULL if this is not one.
+ */
+static char *parse_function_name(parse_state_t *state) {
+    const char *text = state->token.text;
+    size_t length = state->token.length;
+    if (state->token.type != TOKEN_WORD) {
+        return NULL;
+    }
+    if (length > 2 && strncmp(text + length - 2, "()", 2) == 0 &&
+        var_name_length(text) == length - 2) {
+        advance(state);
+        return strndup(text, length - 2);
+    }
+    if (var_name_length(text) != length) {
+        return NULL;
+    }
+    // Look one token further ahead for a separate ()
+    parse_state_t lookahead = *state;
+    advance(&lookahead);
+    if (!is_word(&lookahead, "()")) {
+        return NULL;
+    }
+    *state = lookahead;
+    advance(state);
+    return strndup(text, length);
+}
+
+/* parses a function definition body, with the name already consumed */
+static node_t *parse_function(parse_state_t *state, char *name) {
+    node_t *node = new_node(NODE_FUNCTION);
+    node->name = name;
+    skip_newlines(state);
+    if (expect_word(state, "{")) {
+        node->body = parse_group(state);
+    }
+    if (state->error || state->incomplete) {
+        free_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+/* parses a simple command or a compound command */
+static node_t *parse_command(parse_state_t *state) {
+    char *function_name = parse_function_name(state);
+    if (function_name != NULL) {
+        return parse_function(state, function_name);
+    } else if (is_word(state, "{")) {
+        advance(state);
+        return parse_group(state);
+    } else if (is_word(state, "if")) {
+        advance(state);
+        return parse_if(state);
+    } else if (is_word(state, "while")) {
+        advance(state);
+        return parse_while(state);
+    } else if (is_word(state, "for")) {
+        advance(state);
+        return parse_for(state);
+    } else if (state->token.type != TOKEN_WORD &&
+               state->token.type != TOKEN_IO_NUMBER &&
+               !is_redirect_op(state->token.type)) {
+        unexpected_token(state);
+        return NULL;
+    } else if (is_terminator(state)) {
+        unexpected_token(state);
+        return NULL;
+    }
+    return parse_simple_command(state);
+}
+
+/* parses commands joined by && and ||, which group from the left */
+static node_t *parse_and_or(parse_state_t *state) {
+    node_t *left = parse_command(state);
+    while (left != NULL &&
+           (state->token.type == TOKEN_AND || state->token.type == TOKEN_OR)) {
+        node_t *node =
+            new_node(state->token.type == TOKEN_AND ? NODE_AND : NODE_OR);
+        node->condition = left;
+        advance(state);
+        skip_newlines(state);
+        node->body = parse_command(state);
+        if (node->body == NULL) {
+            free_tree(node);
+            return NULL;
+        }
+        left = node;
+    }
+    return left;
+}
+
+/*
+ * handles a trailing & by marking the command to run in the background,
+ * only simple commands can be run in the background
+ */
+static void parse_background(parse_state_t *state, node_t *item) {
+    if (item->type != NODE_COMMAND) {
+        syntax_error(state, "syntax error: only simple commands can be run "
+                            "in the background");
+        return;
+    }
+    item->background = 1;
+    advance(state);
+}
+
+/* parses commands up to one of the reserved words that close a construct */
+static node_t *parse_compound_list(parse_state_t *state) {
+    node_t *head = NULL;
+    node_t **tail = &head;
+    while (!state->error && !state->incomplete) {
+        skip_newlines(state);
+        if (needs_more(state) || is_terminator(state)) {
+            break;
+        }
+        node_t *item = parse_and_or(state);
+        if (item == NULL) {
+            break;
+        }
+        *tail = item;
+        tail = &item->next;
+        if (state->token.type == TOKEN_SEMI ||
+            state->token.type == TOKEN_NEWLINE) {
+            advance(state);
+        } else if (state->token.type == TOKEN_AMP) {
+            parse_background(state, item);
+        } else if (!is_terminator(state)) {
+            unexpected_token(state);
+        }
+    }
+    if (!state->error && !state->incomplete && head == NULL) {
+        unexpected_token(state);
+    }
+    if (state->error || state->incomplete) {
+        free_tree(head);
+        return NULL;
+    }
+    return head;
+}
+
+/* initializes a parser over the first length characters of src */
+void init_parser(parser_t *parser, const char *src, size_t length,
+                 int at_eof) {
+    parser->src = src;
+    parser->length = length;
+    parser->pos = 0;
+    parser->at_eof = at_eof;
+}
+
+/*
+ * parses the next line of commands, storing the tree in result
+ * returns PARSE_OK with result set, or one of the other results with result
+ * set to NULL. pos is only advanced past text that was fully parsed.
+ */
+parse_result_t parse_next(parser_t *parser, node_t **result) {
+    parse_state_t state = {parser, parser->pos, {TOKEN_EOF, NULL, 0}, 0, 0, 0};
+    *result = NULL;
+    advance(&state);
+    while (state.token.type == TOKEN_NEWLINE) {
+        parser->pos = state.pos;
+        advance(&state);
+    }
+    if (state.token.type == TOKEN_EOF && !state.incomplete) {
+        parser->pos = parser->length;
+        return PARSE_EMPTY;
+    }
+
+    node_t *head = NULL;
+    node_t **tail = &head;
+    // Parse up to the newline, leaving it as the lookahead so that nothing
+    // past the end of the line is read
+    while (!state.error && !state.incomplete) {
+        node_t *item = parse_and_or(&state);
+        if (item == NULL) {
+            break;
+        }
+        *tail = item;
+        tail = &item->next;
+        if (state.token.type == TOKEN_AMP) {
+            parse_background(&state, item);
+        } else if (state.token.type == TOKEN_SEMI) {
+            advance(&state);
+        } else if (state.token.type != TOKEN_NEWLINE &&
+                   state.token.type != TOKEN_EOF) {
+            unexpected_token(&state);
+        }
+        if (state.token.type == TOKEN_NEWLINE) {
+            break;
+        } else if (state.token.type == TOKEN_EOF) {
+            // A line without its newline may still be arriving
+            needs_more(&state);
+            break;
+        }
+    }
+
+    if (state.incomplete && !state.error) {
+        free_tree(head);
+        return PARSE_INCOMPLETE;
+    }
+    if (state.error) {
+        free_tree(head);
+        // Resume after the line holding the error
+        size_t pos = state.pos;
+        if (state.token.type != TOKEN_NEWLINE) {
+            while (pos < parser->length && parser->src[pos] != '\n') {
+                pos++;
+            }
+            if (pos < parser->length) {
+                pos++;
+            }
+        }
+        parser->pos = pos;
+        return PARSE_ERROR;
+    }
+    parser->pos = state.pos;
+    *result = head;
+    return PARSE_OK;
+}
+
+/*
+ * frees a command tree along with every node chained after it, a node that
+ * has been retained only gives up one reference instead
+ */
+void free_tree(node_t *node) {
+    while (node != NULL) {
+        node_t *next = node->next;
+        // A retained node still owns everything after it
+        if (node->refs > 0) {
+            node->refs--;
+            return;
+        }
+        for (int i = 0; node->words != NULL && node->words[i] != NULL; i++) {
+            free(node->words[i]);
+        }
+        free(node->words);
+        for (int i = 0; i < node->redirect_count; i++) {
+            free(node->redirects[i].target);
+        }
+        free(node->redirects);
+        free_tree(node->condition);
+        free_tree(node->body);
+        free_tree(node->else_body);
+        free(node->name);
+        free(node);
+        node = next;
+    }
+}
+
+/* adds a reference to a node, so it survives one more call to free_tree */
+void retain_tree(node_t *node) {
+    if (node != NULL) {
+        node->refs++;
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef PARSER_H_
+#define PARSER_H_
+
+#include <stddef.h>
+
+typedef enum {
+    NODE_COMMAND,
+    NODE_AND,
+    NODE_OR,
+    NODE_IF,
+    NODE_WHILE,
+    NODE_FOR,
+    NODE_GROUP,
+    NODE_FUNCTION
+} node_type_t;
+
+typedef enum {
+    // fd < path, fd > path, fd >> path and fd <> path
+    REDIRECT_INPUT,
+    REDIRECT_OUTPUT,
+    REDIRECT_APPEND,
+    REDIRECT_READ_WRITE,
+    // fd >& target and fd <& target, where target is a descriptor or -
+    REDIRECT_DUP,
+    // fd << word and fd <<- word, target is the body read from the lines
+    // that follow, which is expanded unless the delimiter was quoted
+    REDIRECT_HEREDOC,
+    REDIRECT_HEREDOC_QUOTED,
+    // fd <<< word, target is the word, which is fed in followed by a newline
+    REDIRECT_HERESTRING
+} redirect_type_t;
+
+/*
+ * A single redirection of a simple command. fd is the descriptor being
+ * redirected and target the unexpanded path or descriptor it is set to.
+ * &> path is stored as > path followed by 2>&1.
+ */
+typedef struct redirect {
+    redirect_type_t type;
+    int fd;
+    char *target;
+} redirect_t;
+
+// Most redirections a single simple command can have
+#define MAX_REDIRECTS 64
+
+/*
+ * A parsed command tree. Commands that run one after another are chained
+ * through next. Words are copied out of the source text and kept unexpanded,
+ * so a tree can be executed any number of times after it is parsed once.
+ *
+ * NODE_COMMAND uses words, redirects in the order they were written and
+ * background
+ * NODE_AND and NODE_OR run condition, then body depending on its status
+ * NODE_IF runs condition, then body or else_body (elif becomes a nested if)
+ * NODE_WHILE runs body for as long as condition succeeds
+ * NODE_FOR runs body with the variable name set to each of words in turn,
+ * or to each positional parameter if words is NULL
+ * NODE_GROUP runs the list in body, written { list; }
+ * NODE_FUNCTION defines the function name with body, a NODE_GROUP
+ *
+ * refs counts owners beyond the first, such as the function table holding on
+ * to a function body after the tree it was parsed in has been freed.
+ */
+typedef struct node {
+    node_type_t type;
+    struct node *next;
+    char **words;
+    int word_count;
+    redirect_t *redirects;
+    int redirect_count;
+    int background;
+    struct node *condition;
+    struct node *body;
+    struct node *else_body;
+    char *name;
+    int refs;
+} node_t;
+
+typedef enum {
+    PARSE_OK,
+    // only blank lines and comments were left in the input
+    PARSE_EMPTY,
+    // the input ended in the middle of a command, more lines are needed
+    PARSE_INCOMPLETE,
+    // a syntax error was reported, the rest of its line has been skipped
+    PARSE_ERROR
+} parse_result_t;
+
+// src and length describe the text being parsed, which does not have to be
+// NUL terminated, and pos is how far into it the parser has got.
+// at_eof is set when no more text can follow, otherwise a command that runs
+// into the end of the text is reported as incomplete.
+typedef struct parser {
+    const char *src;
+    size_t length;
+    size_t pos;
+    int at_eof;
+} parser_t;
+
+/* initializes a parser over the first length characters of src */
+void init_parser(parser_t *parser, const char *src, size_t length,
+                 int at_eof);
+
+/*
+ * parses the next line of commands, storing the tree in result
+ * returns PARSE_OK with result set, or one of the other results with result
+ * set to NULL. pos is only advanced past text that was fully parsed.
+ */
+parse_result_t parse_next(parser_t *parser, node_t **result);
+
+/*
+ * frees a command tree along with every node chained after it, a node that
+ * has been retained only gives up one reference instead
+ */
+void free_tree(node_t *node);
+/* adds a reference to a node, so it survives one more call to free_tree */
+void retain_tree(node_t *node);
+
+#endif  // PARSER_H_
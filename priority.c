@@ -0,0 +1,213 @@
+#include "./priority.h"
+#include <errno.h>
+#include <linux/ioprio.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* sets priority to leave the scheduling of a job as it is */
+void init_priority(job_priority_t *priority) {
+    priority->affinity_set = 0;
+    CPU_ZERO(&priority->affinity);
+    priority->nice = 0;
+    priority->policy = -1;
+    priority->ioprio = -1;
+    priority->limit_count = 0;
+    priority->timeout = 0;
+    priority->timeout_signal = SIGTERM;
+    priority->timeout_grace = 0;
+}
+
+/*
+ * sets priority to the low priority class background jobs get with
+ * set -o bgnice
+ */
+void low_priority(job_priority_t *priority) {
+    init_priority(priority);
+    priority->nice = 10;
+    priority->policy = SCHED_BATCH;
+    priority->ioprio = IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT | 7;
+}
+
+/*
+ * parses a number from min to max that makes up all of text, returns 0 on
+ * success, -1 if text is not such a number
+ */
+static int parse_range(const char *text, long min, long max, long *number) {
+    char *end;
+    errno = 0;
+    *number = strtol(text, &end, 10);
+    return *text == '\0' || *end != '\0' || errno != 0 || *number < min ||
+                   *number > max
+               ? -1
+               : 0;
+}
+
+/*
+ * parses a list of CPUs such as 0-3,8 into cpus, returns 0 on success, -1 on
+ * a syntax error
+ */
+static int parse_cpus(const char *list, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    while (1) {
+        char *end;
+        long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first) {
+                return -1;
+            }
+        }
+        if (last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET((size_t)cpu, cpus);
+        }
+        if (*end == '\0') {
+            return 0;
+        }
+        if (*end != ',') {
+            return -1;
+        }
+        list = end + 1;
+    }
+}
+
+/*
+ * parses an I/O class such as be:4 into the value ioprio_set takes, returns
+ * it on success, -1 on a syntax error
+ */
+static int parse_ioprio(const char *text) {
+    const char *level_text = strchr(text, ':');
+    size_t name_length =
+        level_text != NULL ? (size_t)(level_text - text) : strlen(text);
+    int class;
+    long level = 4;
+    if (name_length == 4 && strncmp(text, "idle", 4) == 0) {
+        // The idle class has no levels
+        return level_text == NULL ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT
+                                  : -1;
+    } else if (name_length == 2 && strncmp(text, "be", 2) == 0) {
+        class = IOPRIO_CLASS_BE;
+    } else if (name_length == 2 && strncmp(text, "rt", 2) == 0) {
+        class = IOPRIO_CLASS_RT;
+    } else {
+        return -1;
+    }
+    if (level_text != NULL && parse_range(level_text + 1, 0, 7, &level) == -1) {
+        return -1;
+    }
+    return class << IOPRIO_CLASS_SHIFT | (int)level;
+}
+
+/*
+ * parses the options of sched and stores them in priority, returns the index
+ * in argv of the first word after the options, or -1 on a syntax error,
+ * which has been reported
+ */
+int parse_priority(char *argv[], int argc, job_priority_t *priority) {
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "--") == 0) {
+            return arg + 1;
+        }
+        char *option = argv[arg];
+        // Each option takes a value, given in the same word or the next
+        char *value = option[1] != '\0' && option[2] != '\0' ? option + 2
+                      : arg + 1 < argc                       ? argv[++arg]
+                                                             : NULL;
+        if (option[1] == '\0' || strchr("cnpo", option[1]) == NULL) {
+            fprintf(stderr, "sched: %s: invalid option\n", option);
+            return -1;
+        }
+        if (value == NULL) {
+            fprintf(stderr, "sched: %s: missing value\n", option);
+            return -1;
+        }
+        long nice;
+        switch (option[1]) {
+            case 'c':
+                if (parse_cpus(value, &priority->affinity) == -1) {
+                    fprintf(stderr, "sched: %s: invalid CPU list\n", value);
+                    return -1;
+                }
+                priority->affinity_set = 1;
+                break;
+            case 'n':
+                if (parse_range(value, -20, 19, &nice) == -1) {
+                    fprintf(stderr, "sched: %s: invalid niceness\n", value);
+                    return -1;
+                }
+                priority->nice = (int)nice;
+                break;
+            case 'p':
+                if (strcmp(value, "batch") == 0) {
+                    priority->policy = SCHED_BATCH;
+                } else if (strcmp(value, "idle") == 0) {
+                    priority->policy = SCHED_IDLE;
+                } else if (strcmp(value, "other") == 0) {
+                    priority->policy = SCHED_OTHER;
+                } else {
+                    fprintf(stderr, "sched: %s: invalid policy\n", value);
+                    return -1;
+                }
+                break;
+            default:
+                if ((priority->ioprio = parse_ioprio(value)) == -1) {
+                    fprintf(stderr, "sched: %s: invalid I/O class\n", value);
+                    return -1;
+                }
+                break;
+        }
+    }
+    return arg;
+}
+
+/*
+ * applies priority and its limits to the calling process, returns 0 on
+ * success, -1 on failure, which has been reported
+ */
+int apply_priority(const job_priority_t *priority) {
+    if (apply_limits(priority->limits, priority->limit_count, 1) == -1) {
+        return -1;
+    }
+    // The policy goes first, so the niceness is set under the policy the
+    // job ends up with
+    if (priority->policy != -1) {
+        struct sched_param param = {.sched_priority = 0};
+        if (sched_setscheduler(0, priority->policy, &param) == -1) {
+            perror("sched_setscheduler");
+            return -1;
+        }
+    }
+    if (priority->nice != 0) {
+        errno = 0;
+        if (nice(priority->nice) == -1 && errno != 0) {
+            perror("nice");
+            return -1;
+        }
+    }
+    if (priority->affinity_set &&
+        sched_setaffinity(0, sizeof(cpu_set_t), &priority->affinity) == -1) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    // glibc has no wrapper for ioprio_set
+    if (priority->ioprio != -1 &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority->ioprio) ==
+            -1) {
+        perror("ioprio_set");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef PRIORITY_H_
+#define PRIORITY_H_
+
+#include <sched.h>
+#include "./rlimits.h"
+
+/*
+ * How a job is scheduled and the resource limits it runs under, set in the
+ * job's child before it runs the command, so every process of the job
+ * inherits them
+ */
+typedef struct job_priority {
+    // CPUs the job may run on, if affinity_set
+    int affinity_set;
+    cpu_set_t affinity;
+    // added to the job's niceness, 0 leaves it as it is
+    int nice;
+    // SCHED_OTHER, SCHED_BATCH or SCHED_IDLE, -1 leaves it as it is
+    int policy;
+    // I/O class and level as ioprio_set takes them, -1 leaves it as it is
+    int ioprio;
+    // resource limits set with ulimit -- command
+    job_limit_t limits[MAX_JOB_LIMITS];
+    int limit_count;
+    // nanoseconds the job may run for before it is sent timeout_signal, and
+    // then SIGKILL timeout_grace nanoseconds later, set with timeout, 0 lets
+    // it run for as long as it likes
+    long long timeout;
+    int timeout_signal;
+    long long timeout_grace;
+} job_priority_t;
+
+/* sets priority to leave the scheduling of a job as it is */
+void init_priority(job_priority_t *priority);
+/*
+ * sets priority to the low priority class background jobs get with
+ * set -o bgnice, which is SCHED_BATCH, 10 more niceness and the lowest
+ * best effort I/O level
+ */
+void low_priority(job_priority_t *priority);
+
+/*
+ * parses the options of sched, which are
+ *   -c cpus      run on the listed CPUs only, such as 0-3,8
+ *   -n nice      add nice to the niceness, from -20 to 19
+ *   -p policy    use the batch, idle or other scheduling policy
+ *   -o class     use the idle, be or rt I/O class, followed by :level with
+ *                a level from 0 to 7 for be and rt
+ * and stores them in priority, over whatever it held already
+ * returns the index in argv of the first word after the options, or -1 on a
+ * syntax error, which has been reported
+ */
+int parse_priority(char *argv[], int argc, job_priority_t *priority);
+
+/*
+ * applies priority and its limits to the calling process, returns 0 on
+ * success, -1 on failure, which has been reported
+ */
+int apply_priority(const job_priority_t *priority);
+
+#endif  // PRIORITY_H_
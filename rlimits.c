@@ -0,0 +1,248 @@
+#include "./rlimits.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Each resource ulimit knows along with its option, how it is printed and
+// the size of the units it is given in
+typedef struct resource_entry {
+    char option;
+    int resource;
+    const char *name;
+    const char *unit;
+    rlim_t scale;
+} resource_entry_t;
+
+static const resource_entry_t resources[] = {
+    {'c', RLIMIT_CORE, "core file size", "blocks", 1024},
+    {'d', RLIMIT_DATA, "data seg size", "kbytes", 1024},
+    {'f', RLIMIT_FSIZE, "file size", "blocks", 1024},
+    {'l', RLIMIT_MEMLOCK, "max locked memory", "kbytes", 1024},
+    {'m', RLIMIT_RSS, "max memory size", "kbytes", 1024},
+    {'n', RLIMIT_NOFILE, "open files", NULL, 1},
+    {'s', RLIMIT_STACK, "stack size", "kbytes", 1024},
+    {'t', RLIMIT_CPU, "cpu time", "seconds", 1},
+    {'u', RLIMIT_NPROC, "max user processes", NULL, 1},
+    {'v', RLIMIT_AS, "virtual memory", "kbytes", 1024}};
+
+#define RESOURCE_COUNT (sizeof(resources) / sizeof(resources[0]))
+
+/* finds the resource for an option letter, returns NULL if there is none */
+static const resource_entry_t *find_resource(char option) {
+    for (size_t i = 0; i < RESOURCE_COUNT; i++) {
+        if (resources[i].option == option) {
+            return &resources[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * parses a limit given in units of scale, returns 0 on success, -1 if text
+ * is not a limit
+ */
+static int parse_limit(const char *text, rlim_t scale, rlim_t *value) {
+    if (strcmp(text, "unlimited") == 0) {
+        *value = RLIM_INFINITY;
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long number = strtoull(text, &end, 10);
+    if (*text < '0' || *text > '9' || *end != '\0' || errno != 0 ||
+        number > (RLIM_INFINITY - 1) / scale) {
+        return -1;
+    }
+    *value = (rlim_t)number * scale;
+    return 0;
+}
+
+/*
+ * parses the arguments of ulimit, returns 0 on success, -1 on a syntax
+ * error, which has been reported
+ */
+int parse_ulimit(char *argv[], int argc, ulimit_args_t *args) {
+    int soft = 0;
+    int hard = 0;
+    memset(args, 0, sizeof(ulimit_args_t));
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        if (strcmp(argv[arg], "--") == 0) {
+            if (arg + 1 == argc) {
+                fprintf(stderr, "ulimit: -- needs a command after it\n");
+                return -1;
+            }
+            args->command = arg + 1;
+            break;
+        }
+        const resource_entry_t *last = NULL;
+        for (char *option = argv[arg] + 1; *option != '\0'; option++) {
+            const resource_entry_t *resource = find_resource(*option);
+            if (*option == 'H') {
+                hard = 1;
+            } else if (*option == 'S') {
+                soft = 1;
+            } else if (*option == 'a') {
+                args->all = 1;
+            } else if (resource == NULL) {
+                fprintf(stderr, "ulimit: -%c: invalid option\n", *option);
+                return -1;
+            } else if (last != NULL) {
+                // Only the last resource of a word can be given a limit
+                args->shown[args->shown_count++] = last->option;
+            }
+            if (resource != NULL) {
+                last = resource;
+            }
+            if (args->shown_count + args->limit_count >= MAX_JOB_LIMITS) {
+                fprintf(stderr, "ulimit: too many limits\n");
+                return -1;
+            }
+        }
+        if (last == NULL) {
+            continue;
+        }
+        // A limit follows its option as the next word
+        if (arg + 1 < argc && argv[arg + 1][0] != '-') {
+            job_limit_t *limit = &args->limits[args->limit_count++];
+            limit->resource = last->resource;
+            if (parse_limit(argv[++arg], last->scale, &limit->value) == -1) {
+                fprintf(stderr, "ulimit: %s: invalid limit\n", argv[arg]);
+                return -1;
+            }
+        } else {
+            args->shown[args->shown_count++] = last->option;
+        }
+    }
+    if (args->command == 0 && arg < argc) {
+        // A limit for the default resource, the file size
+        if (arg + 1 < argc || args->limit_count + args->shown_count > 0) {
+            fprintf(stderr, "ulimit: %s: unexpected argument\n", argv[arg]);
+            return -1;
+        }
+        job_limit_t *limit = &args->limits[args->limit_count++];
+        limit->resource = RLIMIT_FSIZE;
+        if (parse_limit(argv[arg], 1024, &limit->value) == -1) {
+            fprintf(stderr, "ulimit: %s: invalid limit\n", argv[arg]);
+            return -1;
+        }
+    }
+    if (args->command != 0 && (args->shown_count > 0 || args->all ||
+                               args->limit_count == 0)) {
+        fprintf(stderr, "ulimit: a command needs limits to run with\n");
+        return -1;
+    }
+    if (!args->all && args->limit_count == 0 && args->shown_count == 0) {
+        args->shown[args->shown_count++] = 'f';
+    }
+    // Setting changes both limits unless one of them is picked
+    for (int i = 0; i < args->limit_count; i++) {
+        args->limits[i].soft = soft || !hard;
+        args->limits[i].hard = hard || !soft;
+    }
+    args->hard = hard && !soft;
+    return 0;
+}
+
+/* prints one limit, with its name and unit if labelled */
+static int print_limit(const resource_entry_t *resource, int hard,
+                       int labelled) {
+    struct rlimit limit;
+    if (getrlimit(resource->resource, &limit) == -1) {
+        perror("getrlimit");
+        return -1;
+    }
+    rlim_t value = hard ? limit.rlim_max : limit.rlim_cur;
+    if (labelled) {
+        char label[64];
+        if (resource->unit != NULL) {
+            snprintf(label, sizeof(label), "(%s, -%c)", resource->unit,
+                     resource->option);
+        } else {
+            snprintf(label, sizeof(label), "(-%c)", resource->option);
+        }
+        printf("%-24s%16s ", resource->name, label);
+    }
+    if (value == RLIM_INFINITY) {
+        printf("unlimited\n");
+    } else {
+        printf("%llu\n", (unsigned long long)(value / resource->scale));
+    }
+    return 0;
+}
+
+/*
+ * prints the limits args asks for, each with its name and unit when more
+ * than one is printed, returns 0 on success, -1 on failure
+ */
+int print_limits(const ulimit_args_t *args) {
+    int labelled = args->all || args->shown_count > 1;
+    if (args->all) {
+        for (size_t i = 0; i < RESOURCE_COUNT; i++) {
+            if (print_limit(&resources[i], args->hard, 1) == -1) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    for (int i = 0; i < args->shown_count; i++) {
+        if (print_limit(find_resource(args->shown[i]), args->hard, labelled) ==
+            -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * sets the given limits for the calling process and its future children,
+ * with job set when they are the limits of a single job,
+ * returns 0 on success, -1 on failure, which has been reported
+ */
+int apply_limits(const job_limit_t limits[], int count, int job) {
+    for (int i = 0; i < count; i++) {
+        struct rlimit limit;
+        if (getrlimit(limits[i].resource, &limit) == -1) {
+            perror("getrlimit");
+            return -1;
+        }
+        if (limits[i].soft) {
+            limit.rlim_cur = limits[i].value;
+        }
+        if (limits[i].hard) {
+            // Going over the hard CPU limit is a plain SIGKILL, so when a
+            // job is given both it is left a second past the soft one, if
+            // that is allowed. The job is sent SIGXCPU first, and reported
+            // as over its CPU limit.
+            if (job && limits[i].soft && limits[i].resource == RLIMIT_CPU &&
+                limits[i].value != RLIM_INFINITY &&
+                (geteuid() == 0 || limits[i].value < limit.rlim_max)) {
+                limit.rlim_max = limits[i].value + 1;
+            } else {
+                limit.rlim_max = limits[i].value;
+            }
+        }
+        if (setrlimit(limits[i].resource, &limit) == -1) {
+            perror("ulimit");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * returns a note for a job killed by sig, such as " (CPU limit)" for
+ * SIGXCPU, if sig is sent for going over a resource limit, "" otherwise
+ */
+const char *limit_signal_note(int sig) {
+    if (sig == SIGXCPU) {
+        return " (CPU limit)";
+    }
+    if (sig == SIGXFSZ) {
+        return " (file size limit)";
+    }
+    return "";
+}
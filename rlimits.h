@@ -0,0 +1,64 @@
+#ifndef RLIMITS_H_
+#define RLIMITS_H_
+
+#include <sys/resource.h>
+
+#define MAX_JOB_LIMITS 16
+
+/* a resource limit to set, on the soft limit, the hard one or both */
+typedef struct job_limit {
+    int resource;
+    int soft;
+    int hard;
+    rlim_t value;
+} job_limit_t;
+
+/* what a ulimit command asks for, as read by parse_ulimit */
+typedef struct ulimit_args {
+    // limits given a value, to be set
+    job_limit_t limits[MAX_JOB_LIMITS];
+    int limit_count;
+    // options of the resources given without a value, to be printed
+    char shown[MAX_JOB_LIMITS];
+    int shown_count;
+    // set with -H, to print hard limits instead of soft ones
+    int hard;
+    // set with -a, to print every limit
+    int all;
+    // index in argv of the command after --, 0 if there is none
+    int command;
+} ulimit_args_t;
+
+/*
+ * parses the arguments of
+ *   ulimit [-HSa] [-cdflmnstuv [limit]]... [-- command [args]]
+ * where each resource option may be followed by a limit, a number in the
+ * units ulimit prints or unlimited, to set it, or stands alone to print it.
+ * -H and -S pick the hard or the soft limit, both are set without them.
+ * With no resource option the file size limit is meant.
+ * returns 0 on success, -1 on a syntax error, which has been reported
+ */
+int parse_ulimit(char *argv[], int argc, ulimit_args_t *args);
+
+/*
+ * prints the limits args asks for, each with its name and unit when more
+ * than one is printed, returns 0 on success, -1 on failure
+ */
+int print_limits(const ulimit_args_t *args);
+
+/*
+ * sets the given limits for the calling process and its future children,
+ * with job set when they are the limits of a single job, whose hard CPU
+ * limit is then left a second past the soft one so it is sent SIGXCPU
+ * before it is killed, returns 0 on success, -1 on failure, which has been
+ * reported
+ */
+int apply_limits(const job_limit_t limits[], int count, int job);
+
+/*
+ * returns a note for a job killed by sig, such as " (CPU limit)" for
+ * SIGXCPU, if sig is sent for going over a resource limit, "" otherwise
+ */
+const char *limit_signal_note(int sig);
+
+#endif  // RLIMITS_H_
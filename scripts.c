@@ -0,0 +1,197 @@
+#include "./scripts.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// dev and ino identify the file, mtime and size tell whether tree is stale
+struct script_element {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    node_t *tree;
+    struct script_element *next;
+};
+typedef struct script_element script_element_t;
+
+// stream_tree is the last script read from a pipe or another file that
+// cannot be cached, kept until the next one is loaded
+struct script_cache {
+    script_element_t *head;
+    node_t *stream_tree;
+};
+
+/* initializes an empty script cache, returns pointer */
+script_cache_t *init_script_cache() {
+    return (script_cache_t *)calloc(1, sizeof(script_cache_t));
+}
+
+/*
+ * cleans up the script cache, releasing every stored tree
+ * Note: this function will free the script_cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_script_cache(script_cache_t *script_cache) {
+    if (script_cache == NULL) {
+        return;
+    }
+    script_element_t *cur = script_cache->head;
+    while (cur != NULL) {
+        script_element_t *next = cur->next;
+        free_tree(cur->tree);
+        free(cur);
+        cur = next;
+    }
+    free_tree(script_cache->stream_tree);
+    free(script_cache);
+}
+
+/*
+ * parses every command in the first length characters of src, chaining the
+ * lines one after another. Lines with syntax errors are reported and left out.
+ */
+static node_t *parse_script(const char *src, size_t length) {
+    parser_t parser;
+    node_t *head = NULL;
+    node_t **tail = &head;
+    node_t *tree;
+    parse_result_t result;
+    init_parser(&parser, src, length, 1);
+    while ((result = parse_next(&parser, &tree)) == PARSE_OK ||
+           result == PARSE_ERROR) {
+        *tail = tree;
+        while (*tail != NULL) {
+            tail = &(*tail)->next;
+        }
+    }
+    return head;
+}
+
+/* maps the open file and parses it, returns 0 on success, -1 on failure */
+static int read_script(int fd, off_t size, node_t **tree) {
+    *tree = NULL;
+    if (size == 0) {
+        return 0;
+    }
+    void *src = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (src == MAP_FAILED) {
+        return -1;
+    }
+    // The parser copies every word it keeps, so the mapping can go right away
+    *tree = parse_script((const char *)src, (size_t)size);
+    munmap(src, (size_t)size);
+    return 0;
+}
+
+/*
+ * reads a script that is not a regular file, such as a process substitution,
+ * to its end and parses it, returns 0 on success, -1 on failure
+ */
+static int read_stream(const char *path, node_t **tree) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    size_t capacity = 16384;
+    size_t length = 0;
+    char *src = (char *)malloc(capacity);
+    while (src != NULL) {
+        if (length == capacity) {
+            char *grown = (char *)realloc(src, capacity * 2);
+            if (grown == NULL) {
+                break;
+            }
+            src = grown;
+            capacity *= 2;
+        }
+        ssize_t bytes_read = read(fd, src + length, capacity - length);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else if (bytes_read <= 0) {
+            close(fd);
+            *tree = bytes_read == 0 ? parse_script(src, length) : NULL;
+            free(src);
+            return bytes_read == 0 ? 0 : -1;
+        }
+        length += (size_t)bytes_read;
+    }
+    free(src);
+    close(fd);
+    errno = ENOMEM;
+    return -1;
+}
+
+/*
+ * loads the script at path, storing its parsed commands chained into one list
+ * in tree, which is NULL for a script without commands. The tree stays owned
+ * by the cache and is reused for as long as the file's device, inode,
+ * modification time and size are unchanged, so loading an unchanged script
+ * again neither reads nor parses it.
+ * returns 0 on success, -1 on failure with errno set
+ */
+int load_script(script_cache_t *script_cache, const char *path,
+                node_t **tree) {
+    struct stat info;
+    if (stat(path, &info) == -1) {
+        return -1;
+    }
+    // Only regular files can be told apart from a later version of themselves
+    if (!S_ISREG(info.st_mode)) {
+        node_t *parsed;
+        if (read_stream(path, &parsed) == -1) {
+            return -1;
+        }
+        // A script that is still running keeps its own reference
+        free_tree(script_cache->stream_tree);
+        script_cache->stream_tree = parsed;
+        *tree = parsed;
+        return 0;
+    }
+    script_element_t *cur = script_cache->head;
+    while (cur != NULL &&
+           (cur->dev != info.st_dev || cur->ino != info.st_ino)) {
+        cur = cur->next;
+    }
+    if (cur != NULL && cur->size == info.st_size &&
+        cur->mtime.tv_sec == info.st_mtim.tv_sec &&
+        cur->mtime.tv_nsec == info.st_mtim.tv_nsec) {
+        *tree = cur->tree;
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    // Key the entry on what was actually opened, in case path just changed
+    node_t *parsed;
+    if (fstat(fd, &info) == -1 ||
+        read_script(fd, info.st_size, &parsed) == -1) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    if (cur == NULL || cur->dev != info.st_dev || cur->ino != info.st_ino) {
+        cur = (script_element_t *)malloc(sizeof(script_element_t));
+        if (cur == NULL) {
+            free_tree(parsed);
+            return -1;
+        }
+        cur->dev = info.st_dev;
+        cur->ino = info.st_ino;
+        cur->tree = NULL;
+        cur->next = script_cache->head;
+        script_cache->head = cur;
+    }
+    // A script that is still running keeps its own reference to the old tree
+    free_tree(cur->tree);
+    cur->tree = parsed;
+    cur->mtime = info.st_mtim;
+    cur->size = info.st_size;
+    *tree = parsed;
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef SCRIPTS_H_
+#define SCRIPTS_H_
+
+#include "./parser.h"
+
+typedef struct script_cache script_cache_t;
+
+/* initializes an empty script cache, returns pointer */
+script_cache_t *init_script_cache();
+/*
+ * cleans up the script cache, releasing every stored tree
+ * Note: this function will free the script_cache pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_script_cache(script_cache_t *script_cache);
+
+/*
+ * loads the script at path, storing its parsed commands chained into one list
+ * in tree, which is NULL for a script without commands. The tree stays owned
+ * by the cache and is reused for as long as the file's device, inode,
+ * modification time and size are unchanged, so loading an unchanged script
+ * again neither reads nor parses it. Scripts that are not regular files, such
+ * as pipes, are read to their end and only kept until the next one is loaded.
+ * returns 0 on success, -1 on failure with errno set
+ */
+int load_script(script_cache_t *script_cache, const char *path,
+                node_t **tree);
+
+#endif  // SCRIPTS_H_
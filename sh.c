@@ -1,337 +1,1056 @@
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
+#include "arena.h"
+#include "arith.h"
+#include "builtins.h"
+#include "cond.h"
+#include "fds.h"
+#include "funcs.h"
+#include "globs.h"
 #include "jobs.h"
+#include "parallel.h"
+#include "parser.h"
+#include "priority.h"
+#include "rlimits.h"
+#include "scripts.h"
+#include "timers.h"
+#include "vars.h"
 
 // Global variable to allow for a change in input count to shell
 size_t count = 1024;
 // Global job list for managing job implementation
 job_list_t *job_list;
 int job_counter = 1;
+// Exit status of the most recent foreground command, expanded by $?
+int last_status = 0;
+// Process id of the most recent background job, expanded by $!
+pid_t last_background_pid = 0;
+// Process id of the shell itself, expanded by $$
+pid_t shell_pid;
+// Global table of shell variables and the environment exported to children
+var_table_t *var_table;
+// Global table of shell functions, consulted after the builtins and before
+// the PATH lookup
+func_table_t *func_table;
+// Global cache of the parsed scripts read by source
+script_cache_t *script_cache;
+// Global cache of the directories read for pathname patterns, kept for the
+// length of one line
+glob_cache_t *glob_cache;
+// Positional parameters $1, $2, ... of the running function and the name
+// expanded by $0
+char **positional_params = NULL;
+int positional_count = 0;
+char *shell_name = "33sh";
+// Set when commands are read from a terminal. Only then are jobs given their
+// own process groups and the terminal, and their progress reported. Children
+// that run shell functions in the background clear it as well.
+int interactive = 0;
+// Set when the prompt is printed, which only interactive shells do
+int show_prompt = 0;
+// Number of function calls currently running, and whether return has been
+// called in the innermost one
+int function_depth = 0;
+int returning = 0;
+// Storage for words rewritten by expand_word, reset for every command
+arena_t *expansion_arena;
+// Exit status of the last command substitution, or -1 if the current
+// command had none
+int substitution_status = -1;
+// The shell's ends of the pipes of pending process substitutions, which are
+// closed once the command they were expanded for has started, and the job
+// their helper processes are counted under
+#define MAX_SUBSTITUTIONS 64
+int substitution_fds[MAX_SUBSTITUTIONS];
+int substitution_count = 0;
+int substitution_jid = 0;
+// Descriptors above 2 that exec has opened in the shell itself, which every
+// command inherits
+#define MAX_PERSISTENT_FDS 64
+int persistent_fds[MAX_PERSISTENT_FDS];
+int persistent_count = 0;
+// Set when the descriptors above 2 the shell inherited could not be made
+// close-on-exec at startup, which leaves them to close_command_fds
+int inherited_fds = 0;
+// Most background jobs that may run at once, the others wait in the job list
+// as queued jobs until one finishes, or 0 for no limit. It defaults to the
+// number of online CPUs, except when the shell is run as 33noprompt on its
+// standard input, where every job starts right away as job control has
+// always done.
+long max_jobs = 0;
+// Set with set -o bgnice, which starts background jobs in the low priority
+// class of low_priority
+int bgnice = 0;
+// Deadlines of the jobs run with timeout, whose signals are sent whenever the
+// shell waits on its jobs or for input
+timer_heap_t *timers;
+// Reads SIGCHLD while the shell waits on its children with SIGCHLD blocked,
+// opened the first time that happens
+int child_signal_fd = -1;
+// The foreground job wait_foreground is waiting on, and its status if
+// process_handler reaped it in the meantime
+pid_t foreground_pid = 0;
+int foreground_reaped = 0;
+int foreground_status = 0;
+// Number of loops currently running, and how many of them a pending break or
+// continue still has to leave
+int loop_depth = 0;
+int breaking = 0;
+int continuing = 0;
+// Set when a foreground job is interrupted from the keyboard, which stops the
+// rest of the current line just like in other shells
+int abort_execution = 0;
+
+// Functions used before they are defined
+size_t run_text(const char *src, size_t length, int at_eof);
+int run_node(node_t *node);
+int run_list(node_t *list);
+int run_script(char *path);
+int set_positional_params(char **args, int count);
+void process_handler(void);
+void start_queued_jobs(void);
+pid_t start_queued_job(int jid);
+void release_dependents(int jid, int status);
+void discard_cancelled_jobs(void);
 
 /*
-     * This function prints errors from parse to fprintf and null resets arrays
-     to prevent segfaults and memory leaks
-     *
-     * msg - the error message to be printed to standard error
-     * tokens - the array of tokens to be reset to null.
-     * argv - arguments array to be reset to null for the next shell prompt
-     *
-     */
-
-void error_reset_handler(char *msg, char *tokens[count / 2],
-                         char *argv[count / 2]) {
-    fprintf(stderr, "%s\n", msg);
-    memset(tokens, '\0', count / 2 * sizeof(char *));
-    memset(argv, '\0', count / 2 * sizeof(char *));
-}
-
-/*
-This function parses input from the buffer and fills out an array of tokens,
-an array of arguments and tracks appropriate input output redirections.
-buffer- a buffer array that contains the input populated by read
-tokens - an null array to be populated by parsed tokens
-argv- a null array to be populated by arguments
-argc - an argument counter used to determine if built in functions have proper
-syntax output_append_path- used to store the file path of ">>" redirection
-output_redirect_path- used to store the file path of ">" redirection
-input_redirect_path - used to store the file path of "<" redirection
-*/
-void parse(char buffer[count], char *tokens[count / 2], char *argv[count / 2],
-           char **output_append_path, char **output_redirect_path,
-           char **input_redirect_path, int *background_flag) {
-    // Counts instances of output redirection
-    int output_redirect_count = 0;
-    // Used to track what type of redirection the previous token was
-    int saw_rdr_flag = 0;
-    // Counts instances of input redirection
-    int input_redirect_count = 0;
-    int index = 0;
-    // Get the first token
-    char *token_pointer = strtok(buffer, " \n\t");
-    // store a previous token to check
-    char *prev_token;
-    // Loop while input exists
-    while (token_pointer != NULL) {
-        // Flags wether the current token is the corresponding redirection
-        // symbol
-        int output_redirect_flag = !strcmp(token_pointer, ">");
-        int input_redirect_flag = !strcmp(token_pointer, "<");
-        int output_append_flag = !strcmp(token_pointer, ">>");
-
-        if (saw_rdr_flag != 0) {
-            // If the previous instance and current instance are both
-            // redirection symbols through an error
-            if (output_append_flag || output_redirect_flag) {
-                error_reset_handler(
-                    "syntax error: output file is a redirection symbol", tokens,
-                    argv);
-                return;
-            } else if (input_redirect_flag) {
-                error_reset_handler(
-                    "syntax error: input file is a redirection symbol", tokens,
-                    argv);
-                return;
-            } else {
-                // Set path files appropriately if previous instance was a
-                // redirection symbol
-                switch (saw_rdr_flag) {
-                    case 1:
-                        (*output_redirect_path) = token_pointer;
-                        saw_rdr_flag = 0;
-                        break;
-                    case 2:
-                        (*input_redirect_path) = token_pointer;
-                        saw_rdr_flag = 0;
-                        break;
-                    case 3:
-                        (*output_append_path) = token_pointer;
-                        saw_rdr_flag = 0;
-                        break;
-                    default:
-                        break;
-                }
-                token_pointer = strtok('\0', " \n\t");
-                // Check if the next token is null, (i.e no file path after
-                // ouput symbol)
-                if ((saw_rdr_flag == 1 || saw_rdr_flag == 3) &&
-                    token_pointer == NULL) {
-                    error_reset_handler("syntax error: no output file", tokens,
-                                        argv);
-                    return;
-                }
-                // Check if the next token is null, (i.e no file path after
-                // input symbol)
-                else if (saw_rdr_flag == 2 && token_pointer == NULL) {
-                    error_reset_handler("syntax error: no input file", tokens,
-                                        argv);
-                    return;
-                }
-                saw_rdr_flag = 0;
-                continue;
-            }
+ * Converts a status filled in by waitpid into the value reported by $?.
+ * Normal exits report their exit code, jobs killed or stopped by a signal
+ * report 128 plus the signal number.
+ *
+ * status - the status integer filled in by waitpid
+ */
+int exit_code_from_status(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    } else if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
+
+/*
+ * Returns the note printed after the number of the signal that terminated a
+ * job, which tells whether its timeout or one of its resource limits is what
+ * killed it.
+ *
+ * sig - the signal that terminated the job
+ * timed_out - whether the job was sent the signal of its timeout
+ */
+const char *signal_note(int sig, int timed_out) {
+    return timed_out ? " (timed out)" : limit_signal_note(sig);
+}
+
+/*
+ * Finds the parenthesis that closes the one at open, skipping over nested
+ * pairs. Returns NULL if it is never closed.
+ *
+ * open - pointer to a '(' character
+ */
+char *matching_paren(char *open) {
+    int depth = 0;
+    for (char *cursor = open; *cursor != '\0'; cursor++) {
+        if (*cursor == '(') {
+            depth++;
+        } else if (*cursor == ')' && --depth == 0) {
+            return cursor;
         }
-        // Count redirect symbols in input line, if more than one exists print
-        // error
-        if (input_redirect_flag) {
-            if (input_redirect_count != 0) {
-                error_reset_handler("syntax error: multiple input files",
-                                    tokens, argv);
-                return;
-            } else {
-                input_redirect_count += 1;
-            }
-        } else if (output_redirect_flag || output_append_flag) {
-            if (output_redirect_count != 0) {
-                error_reset_handler("syntax error: mulitple output files",
-                                    tokens, argv);
-                return;
-            } else {
-                output_redirect_count += 1;
+    }
+    return NULL;
+}
+
+/*
+ * Looks up a positional parameter, $0 being the name of the shell.
+ * Returns an empty string for parameters that are not set.
+ *
+ * index - the number of the parameter
+ */
+char *positional_param(size_t index) {
+    if (index == 0) {
+        return shell_name;
+    } else if (index <= (size_t)positional_count) {
+        return positional_params[index - 1];
+    }
+    return "";
+}
+
+/*
+ * Prepares a forked child to run commands as a subshell, which leaves job
+ * control and the shell's own jobs to the parent.
+ */
+void enter_subshell() {
+    if (interactive) {
+        // Keyboard signals should reach the subshell and its commands
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+    // The shell's jobs belong to the parent, not to this child, and so do
+    // their deadlines
+    job_list = init_job_list();
+    cleanup_timer_heap(timers);
+    timers = init_timer_heap();
+    // The signalfd is opened again should the subshell need one, rather than
+    // left as a number a later descriptor could take
+    if (child_signal_fd != -1) {
+        close(child_signal_fd);
+        child_signal_fd = -1;
+    }
+    interactive = 0;
+    // So do its process substitutions, though a command that was handed their
+    // descriptors keeps them open
+    substitution_count = 0;
+}
+
+/*
+ * Runs the commands of a command substitution in a child shell and appends
+ * their output, without its trailing newlines, to the word being built in
+ * expansion_arena. The output is read straight into the arena with large
+ * reads, so it is never copied through another buffer.
+ * Returns 0 on success, -1 after reporting an error.
+ *
+ * commands - the text between the parentheses, not NUL terminated
+ * length - the length of commands
+ */
+int substitute_command(const char *commands, size_t length) {
+    int fds[2];
+    int status;
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        enter_subshell();
+        if (dup3(fds[1], 1, 0) == -1) {
+            perror("dup3");
+            exit(1);
+        }
+        run_text(commands, length, 1);
+        exit(last_status);
+    }
+    close(fds[1]);
+
+    size_t start;
+    arena_current(expansion_arena, &start);
+    while (1) {
+        size_t available;
+        char *space = arena_reserve(expansion_arena, 16384, &available);
+        if (space == NULL) {
+            perror("malloc");
+            break;
+        }
+        ssize_t bytes_read = read(fds[0], space, available);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else if (bytes_read == -1) {
+            perror("read");
+        }
+        if (bytes_read <= 0) {
+            break;
+        }
+        arena_commit(expansion_arena, (size_t)bytes_read);
+    }
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    substitution_status = exit_code_from_status(status);
+
+    // Trailing newlines are dropped
+    size_t end;
+    char *text = arena_current(expansion_arena, &end);
+    while (end > start && text[end - 1] == '\n') {
+        end--;
+    }
+    arena_truncate(expansion_arena, end);
+    return 0;
+}
+
+/*
+ * Starts the commands of a process substitution, <( ) or >( ), in a child
+ * shell connected to a pipe, and builds the /dev/fd path that names the other
+ * end of the pipe in expansion_arena. The helper process is tracked in the job
+ * list under substitution_jid so it is reaped along with the command it was
+ * started for, and the shell keeps its end open until that command has been
+ * started.
+ * Returns the path on success, NULL after reporting an error.
+ *
+ * word - the whole word, starting with <( or >(
+ */
+char *substitute_process(char *word) {
+    // The command reads what <( ) writes, and writes what >( ) reads
+    int reading = word[0] == '<';
+    int fds[2];
+    if (substitution_count == MAX_SUBSTITUTIONS) {
+        fprintf(stderr, "error: too many process substitutions\n");
+        return NULL;
+    }
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return NULL;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    if (pid == 0) {
+        // Holding on to the pipes of other substitutions would keep them from
+        // seeing the end of their input
+        for (int i = 0; i < substitution_count; i++) {
+            close(substitution_fds[i]);
+        }
+        enter_subshell();
+        if (dup3(fds[reading], reading, 0) == -1) {
+            perror("dup3");
+            exit(1);
+        }
+        // The child does not exec, so a write end left open here would keep
+        // the commands of >( ) from ever seeing the end of their input
+        for (int i = 0; i < 2; i++) {
+            if (fds[i] != reading) {
+                close(fds[i]);
             }
         }
+        run_text(word + 2, strlen(word) - 3, 1);
+        exit(last_status);
+    }
+    close(fds[reading]);
+    if (add_job_helper(job_list, substitution_jid, pid) == -1) {
+        fprintf(stderr, "add helper process error");
+    }
+    int fd = fds[!reading];
+    substitution_fds[substitution_count++] = fd;
 
-        if (output_redirect_flag) {
-            // Set corresponding flag for next instance
-            saw_rdr_flag = 1;
-            token_pointer = strtok('\0', " \n\t");
-            // Check if the next token is null, (i.e no file path after
-            // redirection symbol)
-            if (token_pointer == NULL) {
-                error_reset_handler("syntax error: no output file", tokens,
-                                    argv);
-                return;
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/fd/%d", fd);
+    arena_truncate(expansion_arena, 0);
+    if (arena_append(expansion_arena, path, strlen(path)) == -1) {
+        perror("malloc");
+        return NULL;
+    }
+    return arena_finish(expansion_arena);
+}
+
+/*
+ * Closes the shell's ends of the process substitutions started since first,
+ * once the command they were expanded for no longer needs them.
+ *
+ * first - the number of substitutions pending before the command
+ */
+void finish_substitutions(int first) {
+    while (substitution_count > first) {
+        close(substitution_fds[--substitution_count]);
+    }
+}
+
+/*
+ * Expands the special parameters $?, $!, $$ and $#, the positional parameters
+ * $0 to $9, ${N}, $@ and $*, the variables $NAME and ${NAME}, arithmetic
+ * $(( )) and command substitution $( ) inside a single token. A token that is
+ * a whole process substitution is replaced by its /dev/fd path. Tokens without
+ * a '$' are returned untouched, otherwise the expanded word is built in
+ * expansion_arena and a pointer into the arena is returned. Unset variables
+ * expand to nothing. Returns NULL after reporting an error if an expression is
+ * invalid or memory runs out.
+ *
+ * word - the token to be expanded
+ */
+char *expand_word(char *word) {
+    if ((word[0] == '<' || word[0] == '>') && word[1] == '(' &&
+        matching_paren(word + 1) == word + strlen(word) - 1) {
+        return substitute_process(word);
+    }
+    if (strchr(word, '$') == NULL) {
+        return word;
+    }
+    // Drop whatever an expansion that failed part way left behind
+    arena_truncate(expansion_arena, 0);
+    char *cursor = word;
+    while (*cursor != '\0') {
+        char number[32];
+        const char *piece = number;
+        size_t piece_length;
+        if (cursor[0] != '$') {
+            piece = cursor;
+            piece_length = strcspn(cursor, "$");
+            cursor += piece_length;
+        } else if (cursor[1] == '(' && cursor[2] == '(') {
+            // The inner parentheses must close right before the outer one
+            char *close = matching_paren(cursor + 2);
+            if (close == NULL || close[1] != ')') {
+                fprintf(stderr, "syntax error: bad arithmetic expression\n");
+                return NULL;
             }
-            // Next instantiation of the loop
-            continue;
-        } else if (input_redirect_flag) {
-            // Set corresponding flag for next instance
-            saw_rdr_flag = 2;
-            token_pointer = strtok('\0', " \n\t");
-            // Check if the next token is null, (i.e no file path after
-            // redirection symbol)
-            if (token_pointer == NULL) {
-                error_reset_handler("syntax error: no input file", tokens,
-                                    argv);
-                return;
+            // Parameters such as $1 inside the expression are expanded
+            // first, which needs the arena, so the text so far is set aside
+            char *prefix = arena_finish(expansion_arena);
+            char *expression =
+                strndup(cursor + 3, (size_t)(close - cursor - 3));
+            if (prefix == NULL || expression == NULL) {
+                perror("malloc");
+                free(expression);
+                return NULL;
+            }
+            char *expanded = expand_word(expression);
+            long value;
+            int failed = expanded == NULL ||
+                         arith_eval(var_table, expanded, strlen(expanded),
+                                    &value) == -1;
+            free(expression);
+            if (failed) {
+                return NULL;
+            }
+            arena_truncate(expansion_arena, 0);
+            if (arena_append(expansion_arena, prefix, strlen(prefix)) == -1) {
+                perror("malloc");
+                return NULL;
+            }
+            snprintf(number, sizeof(number), "%ld", value);
+            piece_length = strlen(number);
+            cursor = close + 2;
+        } else if (cursor[1] == '(') {
+            char *close = matching_paren(cursor + 1);
+            if (close == NULL) {
+                fprintf(stderr, "syntax error: unterminated command "
+                                "substitution\n");
+                return NULL;
             }
+            if (substitute_command(cursor + 2, (size_t)(close - cursor - 2)) ==
+                -1) {
+                return NULL;
+            }
+            cursor = close + 1;
             continue;
-        } else if (output_append_flag) {
-            // Set corresponding flag for next instance
-            saw_rdr_flag = 3;
-            token_pointer = strtok('\0', " \n\t");
-            // Check if the next token is null, (i.e no file path after
-            // redirection symbol)
-            if (token_pointer == NULL) {
-                error_reset_handler("syntax error: no output file", tokens,
-                                    argv);
-                return;
+        } else if (cursor[1] == '@' || cursor[1] == '*') {
+            // Every positional parameter, separated by spaces
+            for (int i = 0; i < positional_count; i++) {
+                if ((i > 0 && arena_append(expansion_arena, " ", 1) == -1) ||
+                    arena_append(expansion_arena, positional_params[i],
+                                 strlen(positional_params[i])) == -1) {
+                    perror("malloc");
+                    return NULL;
+                }
             }
+            cursor += 2;
             continue;
-        }
-        tokens[index] = token_pointer;
-        // Check if index is 0, check if first token is a path and move
-        // appropriately
-        if (index == 0) {
-            // In order to set the first ARGV, where the last slash is
-            char *last_slash = strrchr(tokens[0], '/');
-            if (last_slash != NULL) {
-                argv[index] = last_slash + 1;
-                // Count argument counter each time a token is added to argv
-                // (*argc)++;
-            } else {
-                argv[index] = token_pointer;
-                // (*argc)++;
+        } else if (cursor[1] >= '0' && cursor[1] <= '9') {
+            piece = positional_param((size_t)(cursor[1] - '0'));
+            piece_length = strlen(piece);
+            cursor += 2;
+        } else if (cursor[1] == '?' || cursor[1] == '$' || cursor[1] == '!' ||
+                   cursor[1] == '#') {
+            number[0] = '\0';
+            if (cursor[1] == '#') {
+                snprintf(number, sizeof(number), "%d", positional_count);
+            } else if (cursor[1] == '?') {
+                snprintf(number, sizeof(number), "%d", last_status);
+            } else if (cursor[1] == '$') {
+                snprintf(number, sizeof(number), "%d", shell_pid);
+            } else if (last_background_pid > 0) {
+                // $! expands to nothing until a background job has started
+                snprintf(number, sizeof(number), "%d", last_background_pid);
             }
+            piece_length = strlen(number);
+            cursor += 2;
         } else {
-            argv[index] = token_pointer;
-            // (*argc)++;
-        }
-        prev_token = token_pointer;
-        token_pointer = strtok('\0', " \n\t");
-        index++;
-    }
-    // Check for background symbol
-    if (prev_token != NULL && !strcmp(prev_token, "&")) {
-        (*background_flag) = 1;
-        // Remove & from arrays
-        tokens[index - 1] = NULL;
-        argv[index - 1] = NULL;
-    } else {
-        tokens[index] = NULL;
-        argv[index] = NULL;
+            // Find the extent of the variable name, braced or bare
+            int braced = cursor[1] == '{';
+            char *name = cursor + 1 + braced;
+            size_t name_length = var_name_length(name);
+            // ${N} can name positional parameters past $9
+            char *digits_end = name;
+            while (braced && *digits_end >= '0' && *digits_end <= '9') {
+                digits_end++;
+            }
+            if (digits_end != name && *digits_end == '}') {
+                piece = positional_param(strtoul(name, NULL, 10));
+                piece_length = strlen(piece);
+                cursor = digits_end + 1;
+            } else if (name_length == 0 ||
+                       (braced && name[name_length] != '}')) {
+                // Not a parameter, so the '$' stands for itself
+                piece = cursor;
+                piece_length = 1;
+                cursor++;
+            } else {
+                char saved = name[name_length];
+                name[name_length] = '\0';
+                piece = get_var(var_table, name);
+                name[name_length] = saved;
+                if (piece == NULL) {
+                    piece = "";
+                }
+                piece_length = strlen(piece);
+                cursor = name + name_length + braced;
+            }
+        }
+        if (arena_append(expansion_arena, piece, piece_length) == -1) {
+            perror("malloc");
+            return NULL;
+        }
+    }
+    char *expanded = arena_finish(expansion_arena);
+    if (expanded == NULL) {
+        perror("malloc");
     }
+    return expanded;
+}
 
-    // If a redirect path was set, and the argument vectors isn' set through no
-    // command erors.
-    if ((*output_redirect_path || *input_redirect_path ||
-         *output_append_path) &&
-        (*argv) == NULL) {
-        error_reset_handler("error:redirects with no command", tokens, argv);
-        return;
+/*
+ * Checks whether a token is a NAME=value variable assignment.
+ *
+ * token - the token to check
+ */
+int is_assignment(char *token) {
+    char *equals = strchr(token, '=');
+    return equals != NULL && is_var_name(token, (size_t)(equals - token));
+}
+
+/*
+ * Performs a list of NAME=value assignments on the shell's variable table.
+ * Returns 0 on success and 1 if any assignment failed.
+ *
+ * assignments - NULL terminated array of expanded NAME=value tokens
+ * export - nonzero if the assigned variables should also be exported
+ */
+int assign_vars(char *assignments[], int export) {
+    int status = 0;
+    for (int i = 0; assignments[i] != NULL; i++) {
+        char *equals = strchr(assignments[i], '=');
+        *equals = '\0';
+        if (set_var(var_table, assignments[i], equals + 1, export) == -1) {
+            fprintf(stderr, "error assigning %s\n", assignments[i]);
+            status = 1;
+        }
+        *equals = '=';
     }
+    return status;
 }
 
-/* This function handles input output redirection my closing and opening file
-descriptors corresponding to wether the input path exists. input_redirect_path -
-pointer to the input_redirect_path saved from parse output_redirect_path -
-pointer to the output_redirect_path saved from parse output_append - pointer to
-the output_append_path saved from parse
-*/
-void io_redirection(char **input_redirect_path, char **output_redirect_path,
-                    char **output_append) {
-    if ((*input_redirect_path)) {
-        if (close(0) == -1) {
-            perror("close");
-            cleanup_job_list(job_list);
-            exit(1);
+/*
+ * Creates a descriptor to read a here-document or here-string from. Text that
+ * fits in a pipe is written into one, anything larger goes into an anonymous
+ * memory file, so no temporary file is ever created on disk.
+ * Returns the descriptor, or -1 after reporting an error.
+ *
+ * text - the text to be read
+ * newline - nonzero if a newline should follow the text
+ */
+int open_heredoc(char *text, int newline) {
+    struct iovec parts[2] = {{text, strlen(text)}, {"\n", newline ? 1 : 0}};
+    size_t length = parts[0].iov_len + parts[1].iov_len;
+    int fds[2];
+    if (length <= PIPE_BUF) {
+        // The pipe holds all of it, so the write cannot block
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            perror("pipe");
+            return -1;
         }
-        if (open((*input_redirect_path), O_RDONLY, 0666) == -1) {
-            perror("open");
-            cleanup_job_list(job_list);
-            exit(1);
+        if (writev(fds[1], parts, 2) == -1) {
+            perror("write");
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
         }
+        close(fds[1]);
+        return fds[0];
     }
-    if ((*output_redirect_path)) {
-        if (close(1) == -1) {
-            perror("close");
-            cleanup_job_list(job_list);
-            exit(1);
+    if ((fds[0] = memfd_create("heredoc", MFD_CLOEXEC)) == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+    for (int part = 0; part < 2; part++) {
+        char *cursor = (char *)parts[part].iov_base;
+        size_t remaining = parts[part].iov_len;
+        while (remaining > 0) {
+            ssize_t written = write(fds[0], cursor, remaining);
+            if (written == -1) {
+                perror("write");
+                close(fds[0]);
+                return -1;
+            }
+            cursor += written;
+            remaining -= (size_t)written;
         }
-        if (open((*output_redirect_path), O_CREAT | O_TRUNC | O_WRONLY, 0666) ==
-            -1) {
-            perror("open");
-            cleanup_job_list(job_list);
-            exit(1);
+    }
+    if (lseek(fds[0], 0, SEEK_SET) == -1) {
+        perror("lseek");
+        close(fds[0]);
+        return -1;
+    }
+    return fds[0];
+}
+
+/*
+ * Applies the redirections of a command to the current process in the order
+ * they were written. Each file is opened and then moved onto its descriptor
+ * with dup3, so no assumption is made about which descriptors are free.
+ * Returns 0 on success, -1 after reporting an error.
+ *
+ * redirects - the redirections of the command
+ * redirect_count - the number of redirections
+ * targets - the expanded path or descriptor of each redirection
+ */
+int io_redirection(redirect_t *redirects, int redirect_count,
+                   char *targets[MAX_REDIRECTS]) {
+    for (int i = 0; i < redirect_count; i++) {
+        int fd = redirects[i].fd;
+        int source;
+        if (redirects[i].type == REDIRECT_DUP) {
+            char *end;
+            if (strcmp(targets[i], "-") == 0) {
+                // Closing a descriptor that is not open is not an error
+                if (close(fd) == -1 && errno != EBADF) {
+                    perror("close");
+                    return -1;
+                }
+                continue;
+            }
+            source = (int)strtol(targets[i], &end, 10);
+            if (targets[i][0] == '\0' || *end != '\0') {
+                fprintf(stderr, "%s: ambiguous redirect\n", targets[i]);
+                return -1;
+            }
+            // Duplicating a descriptor onto itself only checks it is open
+            if ((source == fd ? fcntl(fd, F_GETFD) : dup3(source, fd, 0)) ==
+                -1) {
+                perror("dup3");
+                return -1;
+            }
+            continue;
         }
-    } else if ((*output_append)) {
-        if (close(1) == -1) {
-            perror("close");
-            cleanup_job_list(job_list);
-            exit(1);
+        redirect_type_t type = redirects[i].type;
+        if (type == REDIRECT_HEREDOC || type == REDIRECT_HEREDOC_QUOTED ||
+            type == REDIRECT_HERESTRING) {
+            source = open_heredoc(targets[i], type == REDIRECT_HERESTRING);
+            if (source == -1) {
+                return -1;
+            }
+        } else {
+            int flags = O_RDONLY;
+            if (type == REDIRECT_OUTPUT) {
+                flags = O_CREAT | O_TRUNC | O_WRONLY;
+            } else if (type == REDIRECT_APPEND) {
+                flags = O_CREAT | O_APPEND | O_WRONLY;
+            } else if (type == REDIRECT_READ_WRITE) {
+                flags = O_CREAT | O_RDWR;
+            }
+            if ((source = open(targets[i], flags | O_CLOEXEC, 0666)) == -1) {
+                perror("open");
+                return -1;
+            }
         }
-        if (open((*output_append), O_CREAT | O_APPEND | O_WRONLY, 0666) == -1) {
-            perror("open");
-            cleanup_job_list(job_list);
-            exit(1);
+        if (source == fd) {
+            // The descriptor was free and open reused it, so it only has to
+            // be kept open across exec
+            if (fcntl(fd, F_SETFD, 0) == -1) {
+                perror("fcntl");
+                return -1;
+            }
+        } else {
+            int result = dup3(source, fd, 0);
+            close(source);
+            if (result == -1) {
+                perror("dup3");
+                return -1;
+            }
         }
     }
+    return 0;
 }
 
 // Executes built in cd command by calling chdir
 // argv- input argument vector
 // argc - pointer to argument counter
-void cd(char *argv[512], int argc) {
+// Returns the exit status of the builtin
+int cd(char *argv[512], int argc) {
     if (argc != 2) {
         fprintf(stderr, "Syntax error with cd");
+        return 1;
     } else if (chdir(argv[1]) != 0) {
         perror("chdir");
+        return 1;
     }
+    return 0;
 }
 
 // Executes built in ln by calling link
 // argv- input argument vector
 // argc - pointer to argument counter
-void ln(char *argv[512], int argc) {
+// Returns the exit status of the builtin
+int ln(char *argv[512], int argc) {
     if (argc != 3) {
         fprintf(stderr, "Syntax error with ln");
+        return 1;
     } else if (link(argv[1], argv[2]) != 0) {
         perror("link");
+        return 1;
     }
+    return 0;
 }
 // Executes built in rm function by calling unlink
 // argv- input argument vector
 // argc - pointer to argument counter
-void rm(char *argv[512], int argc) {
+// Returns the exit status of the builtin
+int rm(char *argv[512], int argc) {
     if (argc != 2) {
         fprintf(stderr, "Syntax error with rm");
+        return 1;
     } else if (unlink(argv[1]) != 0) {
         perror("unlink");
+        return 1;
     }
+    return 0;
 }
-// Executes built in jobs function by calling provided jobs function
+// Executes built in export by marking each named variable as exported,
+// assigning it first when given as NAME=value. Without arguments the exported
+// variables are printed.
+// argv- input argument vector
 // argc - pointer to argument counter
-void jobs_builtin(int argc) {
-    if (argc != 1) {
-        fprintf(stderr, "Syntax error with jobs");
-    } else {
+// Returns the exit status of the builtin
+int export_builtin(char *argv[512], int argc) {
+    int status = 0;
+    if (argc == 1) {
+        print_exports(var_table);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        char *equals = strchr(argv[i], '=');
+        size_t name_length =
+            equals == NULL ? strlen(argv[i]) : (size_t)(equals - argv[i]);
+        if (!is_var_name(argv[i], name_length)) {
+            fprintf(stderr, "export: %s: not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        if (equals != NULL) {
+            *equals = '\0';
+            if (set_var(var_table, argv[i], equals + 1, 1) == -1) {
+                fprintf(stderr, "error exporting %s\n", argv[i]);
+                status = 1;
+            }
+            *equals = '=';
+        } else if (export_var(var_table, argv[i]) == -1) {
+            fprintf(stderr, "error exporting %s\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+// Executes built in unset by removing each named variable, or each named
+// function when given -f
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the exit status of the builtin
+int unset_builtin(char *argv[512], int argc) {
+    int status = 0;
+    int functions = argc > 1 && strcmp(argv[1], "-f") == 0;
+    for (int i = 1 + functions; i < argc; i++) {
+        if (!is_var_name(argv[i], strlen(argv[i]))) {
+            fprintf(stderr, "unset: %s: not a valid identifier\n", argv[i]);
+            status = 1;
+        } else if (functions) {
+            unset_func(func_table, argv[i]);
+        } else if (unset_var(var_table, argv[i]) == -1) {
+            fprintf(stderr, "error unsetting %s\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+/*
+ * Waits out the interval between two samples of jobs -s, sending the signals
+ * of the deadlines that come due in the meantime. An interactive shell stops
+ * waiting as soon as a line is typed, which ends the refreshes.
+ * Returns 0 once the interval has passed, -1 if the refreshes should stop.
+ *
+ * interval - the time to wait in nanoseconds
+ */
+int wait_for_refresh(long long interval) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long end = now.tv_sec * 1000000000LL + now.tv_nsec + interval;
+    // Only a terminal is watched, standard input of a script may well be
+    // readable all along
+    struct pollfd fds[2] = {
+        {.fd = interactive ? 0 : -1, .events = POLLIN, .revents = 0},
+        {.fd = timer_fd(timers), .events = POLLIN, .revents = 0}};
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long left = end - (now.tv_sec * 1000000000LL + now.tv_nsec);
+        if (left <= 0) {
+            return 0;
+        }
+        // Rounded up, so the wait does not end just short of the interval
+        long long milliseconds = (left + 999999) / 1000000;
+        int timeout = milliseconds > INT_MAX ? INT_MAX : (int)milliseconds;
+        if (poll(fds, 2, timeout) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return -1;
+        }
+        if (fds[0].revents != 0) {
+            return -1;
+        }
+        if (fds[1].revents & POLLIN) {
+            expire_timers(timers);
+        }
+    }
+}
+// Executes built in jobs function by calling provided jobs function, or with
+// -s by printing the state, CPU usage and memory of every job, refreshed
+// every interval like top when given one, for as long as jobs are left and,
+// in an interactive shell, until a line is typed
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the exit status of the builtin
+int jobs_builtin(char *argv[512], int argc) {
+    if (argc == 1) {
         jobs(job_list);
+        return 0;
+    }
+    long long interval = 0;
+    if (strcmp(argv[1], "-s") != 0 || argc > 3 ||
+        (argc == 3 &&
+         (parse_duration(argv[2], &interval) == -1 || interval == 0))) {
+        fprintf(stderr, "jobs: usage: jobs [-s [interval]]\n");
+        return 1;
+    }
+    while (1) {
+        if (job_stats(job_list) == -1) {
+            fprintf(stderr, "error printing jobs list\n");
+            return 1;
+        }
+        fflush(stdout);
+        if (interval == 0 || wait_for_refresh(interval) == -1) {
+            return 0;
+        }
+        // Jobs that finished in the meantime are reaped and left out of the
+        // next sample
+        process_handler();
+        if (count_jobs(job_list, RUNNING) + count_jobs(job_list, STOPPED) ==
+            0) {
+            return 0;
+        }
+        printf("\n");
+    }
+}
+// Returns the number of online CPUs, or 1 if it cannot be told
+long online_cpus() {
+    // sysconf reports -1 if it cannot tell
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : cpus;
+}
+// Executes built in maxjobs, which prints the most background jobs that may
+// run at once or sets it, to the number of online CPUs when given -c, and
+// starts queued jobs if the limit was raised
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the exit status of the builtin
+int maxjobs_builtin(char *argv[512], int argc) {
+    if (argc == 1) {
+        printf("%ld\n", max_jobs);
+        return 0;
+    }
+    long limit;
+    char *end;
+    if (argc == 2 && strcmp(argv[1], "-c") == 0) {
+        limit = online_cpus();
+    } else if (argc != 2 || *argv[1] == '\0' ||
+               (limit = strtol(argv[1], &end, 10)) < 0 || *end != '\0') {
+        fprintf(stderr, "maxjobs: usage: maxjobs [count | -c]\n");
+        return 1;
+    }
+    max_jobs = limit;
+    start_queued_jobs();
+    return 0;
+}
+// Executes built in set, which turns the shell options given with -o on and
+// those given with +o off, or lists them all with -o alone. The only option
+// is bgnice, which runs background jobs in a low priority class.
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the exit status of the builtin
+int set_builtin(char *argv[512], int argc) {
+    if (argc == 2 && strcmp(argv[1], "-o") == 0) {
+        printf("bgnice\t%s\n", bgnice ? "on" : "off");
+        return 0;
     }
+    if (argc != 3 ||
+        (strcmp(argv[1], "-o") != 0 && strcmp(argv[1], "+o") != 0)) {
+        fprintf(stderr, "set: usage: set [-o | +o] option\n");
+        return 1;
+    }
+    if (strcmp(argv[2], "bgnice") != 0) {
+        fprintf(stderr, "set: %s: invalid option name\n", argv[2]);
+        return 1;
+    }
+    bgnice = argv[1][0] == '-';
+    return 0;
 }
 // Executed built in bg function by sending kill to all processes that share the
 // job id and updating the job list.
 // argv- input argument vector
 // argc - pointer to argument counter
-void bg(char *argv[512], int argc) {
+// Returns the exit status of the builtin
+int bg(char *argv[512], int argc) {
     if (argc == 2 && argv[0][1] != '\0' && argv[1][0] == '%') {
         // Store job id for job list
         int jid = atoi(&argv[1][1]);
         int pid = get_job_pid(job_list, jid);
         if (pid == -1) {
             fprintf(stderr, "job not found\n");
-        } else {
-            // Use -pid so it sends to all processes that have pid as a process
-            // group id.
-            if (kill(-pid, SIGCONT) == -1) {
-                perror("kill");
+            return 1;
+        }
+        // A queued or waiting job is started right away, whatever maxjobs
+        // or the jobs it waits for say
+        if (pid == 0) {
+            return start_queued_job(jid) == -1;
+        }
+        // Use -pid so it sends to all processes that have pid as a process
+        // group id. Without job control the job has no group of its own.
+        if (kill(interactive ? -pid : pid, SIGCONT) == -1) {
+            perror("kill");
+            return 1;
+        }
+        update_job_jid(job_list, jid, RUNNING);
+        return 0;
+    }
+    fprintf(stderr, "Incorrect Syntax for bg builtin");
+    return 1;
+}
+/*
+ * Returns 1 if the shell has to keep an eye on its children while it waits,
+ * because jobs are queued or wait for other jobs, or deadlines are pending,
+ * 0 if it can simply block.
+ */
+int watching_jobs() {
+    return has_timers(timers) || find_job_jid(job_list, QUEUED) != -1 ||
+           find_job_jid(job_list, WAITING) != -1;
+}
+
+/*
+ * Blocks SIGCHLD, so a child that changes state makes the signalfd read by
+ * the waits readable instead, opening it the first time.
+ * Returns the signalfd, or -1 on failure, which has been reported.
+ *
+ * previous - filled in with the signal mask to put back afterwards
+ */
+int block_child_signal(sigset_t *previous) {
+    sigset_t child;
+    sigemptyset(&child);
+    sigaddset(&child, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &child, previous);
+    if (child_signal_fd == -1) {
+        int fd = signalfd(-1, &child, SFD_CLOEXEC | SFD_NONBLOCK);
+        // It is kept for as long as the shell runs, out of the way of exec
+        if (fd != -1) {
+            child_signal_fd = fcntl(fd, F_DUPFD_CLOEXEC, MIN_SHELL_FD);
+            close(fd);
+        }
+        if (child_signal_fd == -1) {
+            perror("signalfd");
+        }
+    }
+    return child_signal_fd;
+}
+
+/* Empties the signalfd of SIGCHLD, once it has been read as readable. */
+void drain_child_signal() {
+    struct signalfd_siginfo info;
+    while (read(child_signal_fd, &info, sizeof(info)) > 0) {
+    }
+}
+
+/*
+ * Waits for a foreground job to exit or stop, like waitpid with WUNTRACED.
+ * While jobs are queued or waiting, or deadlines are pending, SIGCHLD is
+ * blocked and read from a signalfd, so the wait is a poll on it and the
+ * timerfd of the deadlines. Every other child is reaped as it changes state
+ * meanwhile, which starts the jobs released by it, and deadlines send their
+ * signals as they come due.
+ * Returns the process id, or -1 on failure.
+ *
+ * pid - the process id of the job
+ * status - filled in with the status of the job, as by waitpid
+ */
+pid_t wait_foreground(pid_t pid, int *status) {
+    if (!watching_jobs()) {
+        return waitpid(pid, status, WUNTRACED);
+    }
+    sigset_t previous;
+    if (block_child_signal(&previous) == -1) {
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+        return waitpid(pid, status, WUNTRACED);
+    }
+    // process_handler reaps any child, so it hands this one back
+    foreground_pid = pid;
+    foreground_reaped = 0;
+    pid_t result;
+    while ((result = waitpid(pid, status, WNOHANG | WUNTRACED)) == 0) {
+        process_handler();
+        if (foreground_reaped) {
+            *status = foreground_status;
+            result = pid;
+            break;
+        }
+        struct pollfd fds[2] = {
+            {.fd = child_signal_fd, .events = POLLIN, .revents = 0},
+            {.fd = timer_fd(timers), .events = POLLIN, .revents = 0}};
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
             }
-            update_job_jid(job_list, jid, RUNNING);
+            perror("poll");
+            result = -1;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            drain_child_signal();
+        }
+        if (fds[1].revents & POLLIN) {
+            expire_timers(timers);
         }
-    } else {
-        fprintf(stderr, "Incorrect Syntax for bg builtin");
     }
+    foreground_pid = 0;
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+    return result;
 }
 // Executed built in fg function by sending SIGCONT to the job, placing in the
 // foreground and then reaping properly
 // argv- input argument vector
 // argc - pointer to argument counter
-void fg(char *argv[512], int argc) {
+// Returns the exit status of the job brought to the foreground
+int fg(char *argv[512], int argc) {
     int status;
     if (argc == 2 && argv[0][1] != '\0' && argv[1][0] == '%') {
         // Store job id for job list
@@ -339,17 +1058,33 @@ void fg(char *argv[512], int argc) {
         int pid = get_job_pid(job_list, jid);
         if (pid == -1) {
             fprintf(stderr, "job not found \n");
+            return 1;
         } else {
+            // A queued or waiting job is started right away, whatever
+            // maxjobs or the jobs it waits for say.
+            // Its process group is set here as well, so the terminal can
+            // be handed to it before the child gets to it.
+            if (pid == 0) {
+                // A cancelled job, for one, cannot be started
+                if ((pid = start_queued_job(jid)) == -1) {
+                    fprintf(stderr, "job not found \n");
+                    return 1;
+                }
+                if (interactive && setpgid(pid, pid) == -1 &&
+                    errno != EACCES) {
+                    perror("setpgid");
+                }
+            }
             // Give the foreground job terminal control
-            if (tcsetpgrp(0, pid) == -1) {
+            if (interactive && tcsetpgrp(0, pid) == -1) {
                 perror("tcsetpgrp");
                 // Cleanup jobs list before each exit
                 cleanup_job_list(job_list);
                 exit(1);
             }
             // Send SIGCONT to all processes that have pid as a process group
-            // id.
-            if (kill(-pid, SIGCONT) == -1) {
+            // id. Without job control the job has no group of its own.
+            if (kill(interactive ? -pid : pid, SIGCONT) == -1) {
                 perror("kill");
             }
 
@@ -359,11 +1094,18 @@ void fg(char *argv[512], int argc) {
             }
 
             // Reap the process (wait for status change)
-            waitpid(pid, &status, WUNTRACED);
+            wait_foreground(pid, &status);
 
             // Handle status changes
+            int timed_out = 0;
+            if (!WIFSTOPPED(status)) {
+                timed_out = cancel_timers(timers, pid);
+                release_dependents(jid, status);
+            }
             if (WIFSIGNALED(status)) {
-                printf("(%d) terminated by signal %d", pid, WTERMSIG(status));
+                printf("(%d) terminated by signal %d%s", pid,
+                       WTERMSIG(status),
+                       signal_note(WTERMSIG(status), timed_out));
             } else if (WIFSTOPPED(status)) {
                 // Update job status to stopped
                 if (add_job(job_list, jid, pid, STOPPED, argv[0]) == -1) {
@@ -375,16 +1117,19 @@ void fg(char *argv[512], int argc) {
                 }
             }
             // Return control to shell
-            if (tcsetpgrp(0, getpgrp()) == -1) {
+            if (interactive && tcsetpgrp(0, getpgrp()) == -1) {
                 perror("tcsetpgrp");
                 // Cleanup jobs list before each exit
                 cleanup_job_list(job_list);
                 exit(1);
             }
+            // Like timeout(1), a job killed by its timeout reports 124
+            return timed_out ? 124 : exit_code_from_status(status);
         }
     } else {
         fprintf(stderr, "fg syntax error");
     }
+    return 1;
 }
 // Reaps and handles status changes for foreground processes
 // fg_pid - process id of the foreground process
@@ -395,11 +1140,21 @@ void post_foreground_handler(pid_t fg_pid, char *command) {
     int status;
 
     // Reap foreground process
-    waitpid(fg_pid, &status, WUNTRACED);
+    wait_foreground(fg_pid, &status);
+    int timed_out = !WIFSTOPPED(status) && cancel_timers(timers, fg_pid);
+    // Remember the exit status for $?, which like timeout(1) is 124 for a
+    // job killed by its timeout
+    last_status = timed_out ? 124 : exit_code_from_status(status);
     // Print statement when terminated by signal
     if (WIFSIGNALED(status)) {
-        if (printf("(%d) terminated by signal %d\n", fg_pid,
-                   WTERMSIG(status)) == -1) {
+        // Only an interrupt typed at the terminal stops the rest of the
+        // line, not one sent by a timeout or another process
+        if (interactive && !timed_out && WTERMSIG(status) == SIGINT) {
+            abort_execution = 1;
+        }
+        if (printf("(%d) terminated by signal %d%s\n", fg_pid,
+                   WTERMSIG(status),
+                   signal_note(WTERMSIG(status), timed_out)) == -1) {
             perror("printf");
         }
     }
@@ -418,54 +1173,82 @@ void post_foreground_handler(pid_t fg_pid, char *command) {
     }
 
     // Return terminal control to shell
-    if (tcsetpgrp(0, getpgrp()) == -1) {
+    if (interactive && tcsetpgrp(0, getpgrp()) == -1) {
         perror("tcsetpgrp");
         // Cleanup jobs list before each exit
         cleanup_job_list(job_list);
         exit(1);
     }
 }
-// This function reaps and handles status changes for all processes
+// This function sends the signals of the deadlines that are due, reaps and
+// handles status changes for all processes, and starts queued jobs in place
+// of those that finished
 void process_handler() {
     // Create status integer for waitpid to input info into
     int status;
     // Create a variable to hold pid on success, returns the process ID of
     // the child whose state has changed;
     int pid;
+    // Every child that is not a job has already been waited on, so with no
+    // jobs there is nothing to reap and the system call can be skipped
+    if (!has_jobs(job_list)) {
+        return;
+    }
+    if (has_timers(timers)) {
+        expire_timers(timers);
+    }
     // Use negative one to wait for for any child process whose process
     // group ID is equal to the absolute value of pid. (which should work
     // because we setpgid
     //  to be the same as unique pid)
     while ((pid = waitpid(-1, &status, WNOHANG | WCONTINUED | WUNTRACED)) > 0) {
+        // The foreground job is handed back to wait_foreground, unless it
+        // was only continued
+        if (pid == foreground_pid) {
+            if (!WIFCONTINUED(status)) {
+                foreground_status = status;
+                foreground_reaped = 1;
+            }
+            continue;
+        }
         // Get the job id to handle calls to job functions
         int jid = get_job_jid(job_list, pid);
 
-        // If job isn't in the job list move to next pid
+        // If job isn't in the job list move to next pid, after forgetting
+        // helper processes of jobs once they are gone
         if (jid == -1) {
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                remove_job_helper(job_list, pid);
+            }
             continue;
         }
         // Check termination cases according to order on handout
         if (WIFEXITED(status)) {
+            cancel_timers(timers, pid);
             if (remove_job_pid(job_list, pid) == -1) {
                 fprintf(stderr, "Removing Job after exit error");
-            } else {
+            } else if (interactive) {
                 // remove job did not error so print the exit message
                 printf("[%d] (%d) terminated with exit status %d\n", jid, pid,
                        WEXITSTATUS(status));
             }
+            release_dependents(jid, status);
         } else if (WIFSIGNALED(status)) {
+            int timed_out = cancel_timers(timers, pid);
             if (remove_job_pid(job_list, pid) == -1) {
                 fprintf(stderr, "Removing Job after signal interuption error");
-            } else {
+            } else if (interactive) {
                 // remove job did not error so print the exit message
-                printf("[%d] (%d) terminated by signal %d", jid, pid,
-                       WTERMSIG(status));
+                printf("[%d] (%d) terminated by signal %d%s", jid, pid,
+                       WTERMSIG(status),
+                       signal_note(WTERMSIG(status), timed_out));
             }
+            release_dependents(jid, status);
         } else if (WIFSTOPPED(status)) {
             // Update job status to stopped
             if (update_job_jid(job_list, jid, STOPPED) == -1) {
                 fprintf(stderr, "Updating Job after stopped error");
-            } else {
+            } else if (interactive) {
                 // update job did not error so print the exit message
                 printf("[%d] (%d) suspended by signal %d\n", jid, pid,
                        WSTOPSIG(status));
@@ -474,198 +1257,1845 @@ void process_handler() {
             // Update job status to stopped
             if (update_job_jid(job_list, jid, RUNNING) == -1) {
                 fprintf(stderr, "Updating Job after resumed error");
-            } else {
+            } else if (interactive) {
                 // update job did not error so print the exit message
                 printf("[%d] (%d) resumed\n", jid, pid);
             }
         }
     }
+    start_queued_jobs();
 }
 
-int get_arg_count(char *argv[512]) {
-    int i = 0;
-    while (argv[i] != NULL) {
-        i++;
+// Executes built in break and continue by recording how many of the
+// enclosing loops should stop or move on to their next iteration
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the exit status of the builtin
+int loop_control(char *argv[512], int argc) {
+    int levels = 1;
+    if (argc > 2) {
+        fprintf(stderr, "Syntax error with %s", argv[0]);
+        return 1;
     }
-    return i;
-}
-
-int main() {
-    char buffer[1024];
-    char *tokens[512];
-    char *argv[512];
-    ssize_t input_bytes_read;
-    // Create an argument counter to track potential syntax erors
-    int argc = 0;
-    // Create a variable to track output redirection with append
-    char *output_append_path = NULL;
-    // Create a variable to track output redirection file path
-    char *output_redirect_path = NULL;
-    // Create a variable to track input redirect file path
-    char *input_redirect_path = NULL;
-    // Create a flag to track wether a process is input for background
-    int background_flag = 0;
-    // Create the jobs list
-    job_list = init_job_list();
-    // Job Id
-    // Ignore the following Signals by default
-    // Restore the following Signals to default
-    if (signal(SIGINT, SIG_IGN) == SIG_ERR) {
-        perror("signal");
-        cleanup_job_list(job_list);
-        exit(1);
+    if (argc == 2 && (levels = atoi(argv[1])) < 1) {
+        fprintf(stderr, "%s: loop count out of range\n", argv[0]);
+        return 1;
     }
-    if (signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
-        perror("signal");
-        cleanup_job_list(job_list);
-        exit(1);
+    if (loop_depth == 0) {
+        fprintf(stderr, "%s: only meaningful in a loop\n", argv[0]);
+        return 0;
     }
-    if (signal(SIGTTOU, SIG_IGN) == SIG_ERR) {
-        perror("signal");
-        cleanup_job_list(job_list);
-        exit(1);
+    if (levels > loop_depth) {
+        levels = loop_depth;
     }
-
-#ifdef PROMPT
-    if (printf("33sh> ") < 0) {
-        fprintf(stderr, "Error printing prompt to terminal");
+    if (strcmp(argv[0], "break") == 0) {
+        breaking = levels;
+    } else {
+        continuing = levels;
     }
-    if (fflush(stdout) < 0) {
-        fprintf(stderr, "Error flushing printing terminal prompt");
+    return 0;
+}
+
+// Executes built in exit by cleaning up and leaving the shell
+// argv- input argument vector
+// argc - pointer to argument counter
+void exit_builtin(char *argv[512], int argc) {
+    int status = argc > 1 ? atoi(argv[1]) : last_status;
+    // Clean Job list before every return
+    cleanup_job_list(job_list);
+    cleanup_var_table(var_table);
+    cleanup_func_table(func_table);
+    cleanup_script_cache(script_cache);
+    cleanup_glob_cache(glob_cache);
+    cleanup_timer_heap(timers);
+    cleanup_arena(expansion_arena);
+    exit(status);
+}
+
+// Executes built in return by leaving the innermost function call
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the status given as an argument, or that of the last command
+int return_builtin(char *argv[512], int argc) {
+    if (argc > 2) {
+        fprintf(stderr, "Syntax error with return");
+        return 1;
     }
-#endif
-    // Ensure arrays are all null.
-    memset(buffer, 0, 1024);
-    memset(tokens, 0, 512 * sizeof(char *));
-    memset(argv, 0, 512 * sizeof(char *));
-    while ((input_bytes_read = read(0, buffer, count)) != 0) {
-        // If no input is read return and reprompt
-        if (input_bytes_read == 0) {
-            printf("\n");
-            // Clean before every return
-            cleanup_job_list(job_list);
+    if (function_depth == 0) {
+        fprintf(stderr, "return: can only be used in a function\n");
+        return 1;
+    }
+    returning = 1;
+    return argc == 2 ? atoi(argv[1]) : last_status;
+}
+
+// Executes built in shift by dropping the first positional parameters
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the exit status of the builtin
+int shift(char *argv[512], int argc) {
+    int levels = 1;
+    if (argc > 2) {
+        fprintf(stderr, "Syntax error with shift");
+        return 1;
+    }
+    if (argc == 2 && ((levels = atoi(argv[1])) < 0 ||
+                      levels > positional_count)) {
+        fprintf(stderr, "shift: shift count out of range\n");
+        return 1;
+    }
+    for (int i = 0; i < levels; i++) {
+        free(positional_params[i]);
+    }
+    memmove(positional_params, positional_params + levels,
+            (size_t)(positional_count - levels + 1) * sizeof(char *));
+    positional_count -= levels;
+    return 0;
+}
+
+/*
+ * Consumes a pending break or continue aimed at the innermost loop.
+ * Returns 1 if that loop has to stop, 0 if it should keep iterating.
+ */
+int stop_loop() {
+    if (abort_execution || returning) {
+        return 1;
+    }
+    if (breaking > 0) {
+        breaking--;
+        return 1;
+    }
+    if (continuing > 0) {
+        // Only a continue aimed at an outer loop stops this one
+        continuing--;
+        return continuing > 0;
+    }
+    return 0;
+}
+
+/*
+ * Splits the result of an expansion into fields at blanks and newlines, in
+ * place in the expansion buffer. Words without expansions are stored as they
+ * are. Empty fields are dropped. Fields holding pathname patterns are
+ * replaced by the sorted paths they match, or kept as they are if nothing
+ * matches.
+ * Returns the number of fields stored, or -1 if they do not fit.
+ *
+ * word - the original word
+ * expanded - the word returned by expand_word
+ * fields - array to add the fields to
+ * index - number of fields already in the array
+ * max - maximum number of fields the array can hold
+ */
+int split_fields(char *word, char *expanded, char *fields[], int index,
+                 int max) {
+    int start = index;
+    char *save = NULL;
+    char *field = expanded == word ? word : strtok_r(expanded, " \t\n", &save);
+    for (; field != NULL;
+         field = expanded == word ? NULL : strtok_r(NULL, " \t\n", &save)) {
+        int matches = 0;
+        if (has_glob(field) &&
+            (matches = expand_glob(glob_cache, expansion_arena, field, fields,
+                                   index, max)) == -1) {
+            return -1;
+        }
+        if (matches == 0) {
+            if (index == max) {
+                return -1;
+            }
+            fields[index] = field;
+            matches = 1;
+        }
+        index += matches;
+    }
+    return index - start;
+}
+
+/*
+ * Expands the words of a simple command into the arrays used to run it.
+ * Leading NAME=value words are collected into assignments, the results of
+ * other expansions are split into fields and words that expand to nothing
+ * are dropped. Returns the number of arguments, or -1 after reporting an
+ * error.
+ *
+ * node - the simple command being run
+ * tokens - a null array to be populated by the expanded words
+ * argv - a null array to be populated by arguments, where the first one is
+ * the last component of the command's path
+ * assignments - a null array to be populated by NAME=value words
+ */
+int expand_command(node_t *node, char *tokens[512], char *argv[512],
+                   char *assignments[512]) {
+    int index = 0;
+    int assignment_index = 0;
+    for (int i = 0; i < node->word_count; i++) {
+        char *word = expand_word(node->words[i]);
+        if (word == NULL) {
+            return -1;
+        }
+        // Assignments before the command word set its environment
+        if (index == 0 && is_assignment(node->words[i])) {
+            assignments[assignment_index] = word;
+            assignment_index++;
+            continue;
+        }
+        // A word that expanded to nothing is dropped entirely
+        if (word[0] == '\0') {
+            continue;
+        }
+        int fields = split_fields(node->words[i], word, tokens, index, 511);
+        if (fields == -1) {
+            fprintf(stderr, "error: too many arguments\n");
+            return -1;
+        }
+        for (int field = index; field < index + fields; field++) {
+            // In order to set the first ARGV, where the last slash is
+            char *last_slash = field == 0 ? strrchr(tokens[0], '/') : NULL;
+            argv[field] = last_slash != NULL ? last_slash + 1 : tokens[field];
+        }
+        index += fields;
+    }
+    tokens[index] = NULL;
+    argv[index] = NULL;
+    assignments[assignment_index] = NULL;
+    return index;
+}
+
+/*
+ * Calls a shell function, or a sourced script, inside the shell process. The
+ * arguments become the positional parameters for the duration of the call and
+ * the body runs straight from its parsed tree, so nothing is forked or parsed
+ * again. Returns the exit status of the function.
+ *
+ * body - the parsed body of the function
+ * argv - the arguments of the call, where argv[0] is the function's name, or
+ * NULL to keep the current positional parameters
+ * argc - the number of arguments
+ */
+int call_function(node_t *body, char *argv[512], int argc) {
+    char **saved_params = positional_params;
+    int saved_count = positional_count;
+    // The arguments live in the expansion buffer, which the body reuses, so
+    // they are copied. The caller's own parameters are kept aside.
+    positional_params = NULL;
+    positional_count = 0;
+    if (argv != NULL ? set_positional_params(argv + 1, argc - 1)
+                     : set_positional_params(saved_params, saved_count)) {
+        positional_params = saved_params;
+        positional_count = saved_count;
+        return 1;
+    }
+    int saved_loop_depth = loop_depth;
+    // break and continue cannot reach loops outside of the function
+    loop_depth = 0;
+    function_depth++;
+    // Keep the body alive even if the function redefines itself
+    retain_tree(body);
+    int status = run_list(body);
+    free_tree(body);
+    function_depth--;
+    returning = 0;
+    loop_depth = saved_loop_depth;
+    for (int i = 0; i < positional_count; i++) {
+        free(positional_params[i]);
+    }
+    free(positional_params);
+    positional_params = saved_params;
+    positional_count = saved_count;
+    return status;
+}
+
+// Executes built in source and . by running the commands of a script in the
+// shell itself. Scripts are parsed once and then reused until they change.
+// argv- input argument vector
+// argc - pointer to argument counter
+// Returns the exit status of the last command in the script
+int source_builtin(char *argv[512], int argc) {
+    node_t *tree;
+    if (argc < 2) {
+        fprintf(stderr, "Syntax error with %s", argv[0]);
+        return 1;
+    }
+    if (load_script(script_cache, argv[1], &tree) == -1) {
+        perror(argv[1]);
+        return 1;
+    }
+    last_status = 0;
+    // Extra arguments become the positional parameters of the script
+    return call_function(tree, argc > 2 ? argv + 1 : NULL, argc - 1);
+}
+
+/*
+ * Runs a file that execve rejected as not being an executable format as a
+ * shell script, inside the child that was forked for it. The child is reset
+ * to what a newly started shell would have, the environment it was handed and
+ * no functions, and then parses the file itself instead of starting another
+ * shell for it. Only returns if the file could not be read.
+ *
+ * path - the path the file was found at, which becomes $0
+ * argv - the argument vector for the command
+ * envp - the environment for the command
+ */
+void exec_script(char *path, char *argv[], char **envp) {
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        argc++;
+    }
+    enter_subshell();
+    var_table_t *script_vars = init_var_table(envp);
+    cleanup_var_table(var_table);
+    var_table = script_vars;
+    cleanup_func_table(func_table);
+    func_table = init_func_table();
+    function_depth = 0;
+    loop_depth = 0;
+    // The path and arguments may live in the expansion buffer, which the
+    // script's own commands reuse
+    if ((shell_name = strdup(path)) == NULL ||
+        set_positional_params(argv + 1, argc - 1) == -1) {
+        exit(1);
+    }
+    if (run_script(shell_name) == -1) {
+        exit(126);
+    }
+    exit(last_status);
+}
+
+/*
+ * Executes a command, searching the directories in PATH for names that do
+ * not contain a slash. Files without a #! line or executable format are run
+ * as shell scripts by exec_script. Only returns if the command could not be
+ * executed.
+ *
+ * path - the command's name or path
+ * argv - the argument vector for the command
+ * envp - the environment for the command
+ */
+void exec_command(char *path, char *argv[], char **envp) {
+    if (strchr(path, '/') != NULL) {
+        execve(path, argv, envp);
+        if (errno == ENOEXEC) {
+            exec_script(path, argv, envp);
+        }
+        return;
+    }
+    char *search = get_var(var_table, "PATH");
+    if (search == NULL) {
+        search = "/usr/local/bin:/usr/bin:/bin";
+    }
+    int denied = 0;
+    size_t path_length = strlen(path);
+    while (1) {
+        char *separator = strchrnul(search, ':');
+        size_t dir_length = (size_t)(separator - search);
+        char candidate[4096];
+        // An empty entry stands for the current directory
+        if (dir_length + path_length + 2 <= sizeof(candidate)) {
+            memcpy(candidate, search, dir_length);
+            if (dir_length == 0) {
+                candidate[dir_length++] = '.';
+            }
+            candidate[dir_length] = '/';
+            memcpy(candidate + dir_length + 1, path, path_length + 1);
+            execve(candidate, argv, envp);
+            if (errno == ENOEXEC) {
+                exec_script(candidate, argv, envp);
+                return;
+            }
+            denied |= errno == EACCES;
+        }
+        if (*separator == '\0') {
+            break;
+        }
+        search = separator + 1;
+    }
+    errno = denied ? EACCES : ENOENT;
+}
+
+/* Orders descriptors for close_command_fds. */
+int compare_fds(const void *left, const void *right) {
+    return *(const int *)left - *(const int *)right;
+}
+
+/*
+ * Closes every descriptor above 2 in a child that is about to run a command,
+ * except those opened by exec and the pipes of the command's process
+ * substitutions, so nothing the shell inherited leaks into it. The shell's
+ * own descriptors are close-on-exec, and so are the inherited ones once main
+ * has marked them, so this only has work to do if that failed. The gaps
+ * between the descriptors kept are closed with close_range. Failures are
+ * ignored.
+ */
+void close_command_fds() {
+    if (!inherited_fds) {
+        return;
+    }
+    int keep[MAX_PERSISTENT_FDS + MAX_SUBSTITUTIONS];
+    int keep_count = 0;
+    for (int i = 0; i < persistent_count; i++) {
+        keep[keep_count++] = persistent_fds[i];
+    }
+    for (int i = 0; i < substitution_count; i++) {
+        keep[keep_count++] = substitution_fds[i];
+    }
+    qsort(keep, (size_t)keep_count, sizeof(int), compare_fds);
+    unsigned int low = 3;
+    for (int i = 0; i < keep_count; i++) {
+        if ((unsigned int)keep[i] > low) {
+            close_range(low, (unsigned int)keep[i] - 1, 0);
+        }
+        if ((unsigned int)keep[i] >= low) {
+            low = (unsigned int)keep[i] + 1;
+        }
+    }
+    close_range(low, ~0U, 0);
+}
+
+/*
+ * Records the descriptors exec has just redirected in the shell itself, so
+ * close_command_fds leaves them open for later commands.
+ *
+ * redirects - the redirections exec applied
+ * redirect_count - the number of redirections
+ * targets - the expanded path or descriptor of each redirection
+ */
+void keep_persistent_fds(redirect_t *redirects, int redirect_count,
+                         char *targets[MAX_REDIRECTS]) {
+    for (int i = 0; i < redirect_count; i++) {
+        int fd = redirects[i].fd;
+        if (fd <= 2) {
+            continue;
+        }
+        int index = 0;
+        while (index < persistent_count && persistent_fds[index] != fd) {
+            index++;
+        }
+        if (redirects[i].type == REDIRECT_DUP && strcmp(targets[i], "-") == 0) {
+            if (index < persistent_count) {
+                persistent_fds[index] = persistent_fds[--persistent_count];
+            }
+        } else if (index == persistent_count &&
+                   persistent_count < MAX_PERSISTENT_FDS) {
+            persistent_fds[persistent_count++] = fd;
+        }
+    }
+}
+
+// Executes built in exec. With a command, the shell is replaced by it after its
+// jobs have been cleaned up just as on exit. Without one, the redirections are
+// applied to the shell itself, so they stay in place for every later command.
+// node - the command, whose redirections are applied
+// tokens - the expanded words, tokens[0] being exec itself
+// assignments - NAME=value words that preceded exec
+// targets - the expanded path or descriptor of each redirection
+// Returns the exit status if the shell is not replaced
+int exec_builtin(node_t *node, char *tokens[512], char *assignments[512],
+                 char *targets[MAX_REDIRECTS]) {
+    // The shell's own descriptors must survive the redirections that stay,
+    // either as their descriptor or as the one they copy
+    for (int i = 0; tokens[1] == NULL && i < node->redirect_count; i++) {
+        int fd = node->redirects[i].fd;
+        if (node->redirects[i].type == REDIRECT_DUP && fd < MIN_SHELL_FD &&
+            strcmp(targets[i], "-") != 0) {
+            fd = atoi(targets[i]);
+        }
+        if (fd >= MIN_SHELL_FD) {
+            fprintf(stderr, "exec: %d: descriptor reserved by the shell\n",
+                    fd);
+            return 1;
+        }
+    }
+    // Output buffered for the old descriptors must go to them
+    fflush(stdout);
+    if (io_redirection(node->redirects, node->redirect_count, targets) == -1) {
+        return 1;
+    }
+    if (tokens[1] == NULL) {
+        keep_persistent_fds(node->redirects, node->redirect_count, targets);
+        return assign_vars(assignments, 0);
+    }
+    if (assign_vars(assignments, 1) != 0) {
+        return 1;
+    }
+    cleanup_job_list(job_list);
+    job_list = init_job_list();
+    // The command inherits the process substitutions of its line
+    for (int i = 0; i < substitution_count; i++) {
+        fcntl(substitution_fds[i], F_SETFD, 0);
+    }
+    // Ignored signals would stay ignored in the new program
+    if (interactive) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+    char *last_slash = strrchr(tokens[1], '/');
+    char *path = tokens[1];
+    tokens[1] = last_slash != NULL ? last_slash + 1 : path;
+    exec_command(path, tokens + 1, get_envp(var_table));
+    int missing = errno == ENOENT;
+    perror(path);
+    exit(missing ? 127 : 126);
+}
+
+/*
+ * Checks whether cat can run in the shell without keeping it from the
+ * keyboard. An interactive shell ignores SIGINT and SIGTSTP, so cat is only
+ * run in it when every input is a regular file, which is read to its end
+ * without waiting. Here-documents count as well, as their text is all there
+ * before cat starts. Files that cannot be looked at are left to cat to report.
+ * Returns 1 if every input is a regular file, 0 otherwise.
+ *
+ * node - the command, whose redirections may replace standard input
+ * argv, argc - the arguments of cat
+ * targets - the expanded path or descriptor of each redirection
+ */
+int reads_regular_files(node_t *node, char *argv[], int argc,
+                        char *targets[MAX_REDIRECTS]) {
+    struct stat info;
+    int reads_stdin = argc == 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-") == 0) {
+            reads_stdin = 1;
+        } else if (stat(argv[i], &info) == 0 && !S_ISREG(info.st_mode)) {
             return 0;
         }
-        // check for read error
-        else if (input_bytes_read == -1) {
-            perror("read");
+    }
+    if (!reads_stdin) {
+        return 1;
+    }
+    // Standard input is whatever the last redirection of it leaves there
+    int stdin_fd = 0;
+    for (int i = node->redirect_count - 1; i >= 0; i--) {
+        if (node->redirects[i].fd != 0) {
+            continue;
+        }
+        switch (node->redirects[i].type) {
+            case REDIRECT_HEREDOC:
+            case REDIRECT_HEREDOC_QUOTED:
+            case REDIRECT_HERESTRING:
+                return 1;
+            case REDIRECT_DUP:
+                stdin_fd = atoi(targets[i]);
+                break;
+            default:
+                return stat(targets[i], &info) == -1 || S_ISREG(info.st_mode);
         }
-        // Set end of the read input to Null
-        buffer[input_bytes_read] = '\0';
-        parse(buffer, tokens, argv, &output_append_path,
-              &output_redirect_path, &input_redirect_path, &background_flag);
+        break;
+    }
+    return fstat(stdin_fd, &info) == 0 && S_ISREG(info.st_mode);
+}
 
+/*
+ * Runs a builtin that stands in for an external command in the shell itself,
+ * with the command's redirections applied for as long as it runs. Every
+ * descriptor a redirection replaces is first saved above 10, and put back
+ * afterwards, so the builtin costs a few descriptor operations rather than a
+ * fork.
+ * Returns the exit status of the builtin, or 1 if a redirection failed or its
+ * output could not be written.
+ *
+ * builtin - the builtin to run
+ * node - the command, whose redirections are applied
+ * argv - the arguments of the builtin
+ * argc - the number of arguments
+ * targets - the expanded path or descriptor of each redirection
+ */
+int run_redirected(builtin_t builtin, node_t *node,
+                   char *argv[512], int argc, char *targets[MAX_REDIRECTS]) {
+    // Descriptors saved before each redirection, -1 for ones that were closed
+    int saved[MAX_REDIRECTS];
+    int saved_count = 0;
+    int status = 1;
+    fflush(stdout);
+    while (saved_count < node->redirect_count) {
+        int fd = node->redirects[saved_count].fd;
+        if ((saved[saved_count] = fcntl(fd, F_DUPFD_CLOEXEC, MIN_SHELL_FD)) ==
+                -1 &&
+            errno != EBADF) {
+            perror("fcntl");
+            break;
+        }
+        saved_count++;
+    }
+    if (saved_count == node->redirect_count &&
+        io_redirection(node->redirects, node->redirect_count, targets) == 0) {
+        status = builtin(argv, argc);
+        // Output that could not be written fails the builtin, as it would
+        // the external command
+        if (fflush(stdout) == EOF || ferror(stdout)) {
+            fprintf(stderr, "%s: write error: %s\n", argv[0], strerror(errno));
+            status = 1;
+        }
+        clearerr(stdout);
+    }
+    // Later redirections of the same descriptor saved what earlier ones put
+    // there, so they are undone in reverse
+    for (int i = saved_count - 1; i >= 0; i--) {
+        int fd = node->redirects[i].fd;
+        if (saved[i] == -1) {
+            close(fd);
+        } else {
+            dup3(saved[i], fd, 0);
+            close(saved[i]);
+        }
+    }
+    return status;
+}
 
-        argc = get_arg_count(argv);
+/*
+ * Runs a command in the child forked for it, setting up its process group,
+ * signals, descriptors, variables and scheduling before running the shell
+ * function or executing the program. Never returns.
+ *
+ * node - the command node, for its redirections and whether it runs in the
+ *        background
+ * tokens, argv, argc - the expanded words of the command
+ * assignments - the NAME=value assignments that precede the command
+ * targets - the expanded redirection targets
+ * function - the shell function to call, or NULL to execute tokens[0]
+ * priority - how to schedule the command, or NULL to leave it as it is
+ */
+void run_child(node_t *node, char *tokens[], char *argv[], int argc,
+               char *assignments[], char *targets[], node_t *function,
+               const job_priority_t *priority) {
+    // Find the unique Process id. A job run with timeout is given a process
+    // group of its own either way, like timeout(1) does, for its signals to
+    // reach every process of the job.
+    if ((interactive || (priority != NULL && priority->timeout > 0)) &&
+        setpgid(0, 0) == -1) {
+        perror("setpgid");
+        exit(1);
+    }
+    // If the process is not running in the background, set
+    // the controlling terminal
+    if (interactive && !node->background) {
+        if (tcsetpgrp(0, getpgrp()) == -1) {
+            perror("tcsetpgrp");
+            exit(1);
+        }
+    }
 
-        char *built_in = tokens[0];
+    // Restore the following Signals to default, which only an
+    // interactive shell changed in the first place
+    if (interactive) {
+        if (signal(SIGINT, SIG_DFL) == SIG_ERR) {
+            perror("signal");
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+        if (signal(SIGTSTP, SIG_DFL) == SIG_ERR) {
+            perror("signal");
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+        if (signal(SIGTTOU, SIG_DFL) == SIG_ERR) {
+            perror("signal");
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+    }
 
-        if (built_in != NULL) {
-            // Check if the first token matches built ins and handle
-            // appropriately
-            if (strcmp(built_in, "exit") == 0) {
-                // Clean Job list before every return
-                cleanup_job_list(job_list);
-                return 0;
-            } else if (strcmp(built_in, "cd") == 0) {
-                cd(argv, argc);
-            } else if (strcmp(built_in, "ln") == 0) {
-                ln(argv, argc);
-            } else if (strcmp(built_in, "rm") == 0) {
-                rm(argv, argc);
-            } else if (strcmp(built_in, "jobs") == 0) {
-                jobs_builtin(argc);
-            } else if (strcmp(built_in, "bg") == 0) {
-                bg(argv, argc);
-            } else if (strcmp(built_in, "fg") == 0) {
-                fg(argv, argc);
+    close_command_fds();
+    // The command is handed the pipes of its process substitutions
+    for (int i = 0; i < substitution_count; i++) {
+        if (fcntl(substitution_fds[i], F_SETFD, 0) == -1) {
+            perror("fcntl");
+            exit(1);
+        }
+    }
+    if (io_redirection(node->redirects, node->redirect_count, targets) == -1) {
+        cleanup_job_list(job_list);
+        exit(1);
+    }
+    // Prefix assignments only go into this child's copy of the
+    // variable table, which updates its envp in place
+    if (assign_vars(assignments, 1) != 0) {
+        exit(1);
+    }
+    if (priority != NULL && apply_priority(priority) == -1) {
+        exit(1);
+    }
+    if (function != NULL) {
+        enter_subshell();
+        exit(call_function(function, argv, argc));
+    }
+    exec_command(tokens[0], argv, get_envp(var_table));
+    perror("execv");
+
+    exit(1);
+}
+
+/*
+ * Adds the deadline of a job run with timeout, once its child has been
+ * forked. The job's process group, which is set here too so it is in place
+ * before the deadline can come, is signalled as a whole. A job whose
+ * deadline cannot be added is killed rather than left to run without one.
+ *
+ * pid - the process id of the job
+ * priority - how the job is scheduled, or NULL, which has no timeout either
+ */
+void start_timeout(pid_t pid, const job_priority_t *priority) {
+    if (priority == NULL || priority->timeout == 0) {
+        return;
+    }
+    if (setpgid(pid, pid) == -1 && errno != EACCES) {
+        perror("setpgid");
+    }
+    if (add_timer(timers, pid, -pid, priority->timeout,
+                  priority->timeout_signal, priority->timeout_grace) == -1) {
+        perror("timeout");
+        kill(-pid, SIGKILL);
+    }
+}
+
+// A background command held back by maxjobs until a running job finishes.
+// Its words are expanded when it is queued and copied out of the expansion
+// arena, into the same allocation as the struct and the arrays pointing to
+// them. The node is retained for its redirections, and the function, if the
+// command calls one, for its body.
+typedef struct queued_command {
+    node_t *node;
+    node_t *function;
+    // how to schedule the command, if prioritized
+    int prioritized;
+    job_priority_t priority;
+    int argc;
+    char **tokens;
+    char **argv;
+    char **assignments;
+    char **targets;
+} queued_command_t;
+
+/*
+ * Copies words to strings and stores pointers to the copies in copies, which
+ * is ended with NULL.
+ * Returns the end of the copied strings.
+ *
+ * words - the words to copy
+ * count - the number of words
+ * copies - where to store the pointers to the copies
+ * strings - where to copy the words to
+ */
+char *copy_words(char *words[], int count, char *copies[], char *strings) {
+    for (int i = 0; i < count; i++) {
+        size_t length = strlen(words[i]) + 1;
+        copies[i] = memcpy(strings, words[i], length);
+        strings += length;
+    }
+    copies[count] = NULL;
+    return strings;
+}
+
+/*
+ * Adds a background command to the job list as a queued job, to be started
+ * by start_queued_jobs once fewer than maxjobs jobs are running, and once the
+ * jobs it runs after have finished.
+ * Returns 0 on success, 1 on failure or if the job is cancelled right away,
+ * as it requires a job that has already failed to succeed.
+ *
+ * node - the command node
+ * tokens, argc - the expanded words of the command
+ * assignments - the NAME=value assignments that precede the command
+ * targets - the expanded redirection targets
+ * function - the shell function the command calls, or NULL
+ * priority - how to schedule the command, or NULL to leave it as it is
+ * after, after_count - the JIDs of the jobs to wait for
+ * require_success - whether those jobs have to succeed for it to run
+ */
+int queue_command(node_t *node, char *tokens[], int argc, char *assignments[],
+                  char *targets[], node_t *function,
+                  const job_priority_t *priority, int after[],
+                  int after_count, int require_success) {
+    int assignment_count = 0;
+    while (assignments[assignment_count] != NULL) {
+        assignment_count++;
+    }
+    size_t pointer_count =
+        (size_t)(2 * argc + assignment_count + node->redirect_count + 4);
+    size_t size = sizeof(queued_command_t) + pointer_count * sizeof(char *);
+    for (int i = 0; i < argc; i++) {
+        size += strlen(tokens[i]) + 1;
+    }
+    for (int i = 0; i < assignment_count; i++) {
+        size += strlen(assignments[i]) + 1;
+    }
+    for (int i = 0; i < node->redirect_count; i++) {
+        size += strlen(targets[i]) + 1;
+    }
+
+    queued_command_t *queued = (queued_command_t *)malloc(size);
+    if (queued == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    queued->node = node;
+    queued->function = function;
+    queued->prioritized = priority != NULL;
+    if (priority != NULL) {
+        queued->priority = *priority;
+    }
+    queued->argc = argc;
+    queued->tokens = (char **)(queued + 1);
+    queued->argv = queued->tokens + argc + 1;
+    queued->assignments = queued->argv + argc + 1;
+    queued->targets = queued->assignments + assignment_count + 1;
+    char *strings = (char *)(queued->targets + node->redirect_count + 1);
+    strings = copy_words(tokens, argc, queued->tokens, strings);
+    strings = copy_words(assignments, assignment_count, queued->assignments,
+                         strings);
+    copy_words(targets, node->redirect_count, queued->targets, strings);
+    // argv shares the copied words, but names the program without its path
+    for (int i = 0; i <= argc; i++) {
+        queued->argv[i] = queued->tokens[i];
+    }
+    char *last_slash = strrchr(queued->tokens[0], '/');
+    if (last_slash != NULL) {
+        queued->argv[0] = last_slash + 1;
+    }
+
+    int waiting;
+    if (queue_job(job_list, job_counter, tokens[0], queued) == -1 ||
+        (waiting = add_job_dependencies(job_list, job_counter, after,
+                                        after_count, require_success)) == -1) {
+        fprintf(stderr, "queue background job error\n");
+        remove_job_jid(job_list, job_counter);
+        free(queued);
+        return 1;
+    }
+    retain_tree(node);
+    retain_tree(function);
+    // A job that needs a job which has already failed is dropped right away
+    int cancelled = find_job_jid(job_list, CANCELLED) == job_counter;
+    if (interactive && !cancelled &&
+        printf("[%d] %s\n", job_counter, waiting > 0 ? "waiting" : "queued") <
+            0) {
+        perror("printf");
+    }
+    job_counter++;
+    if (cancelled) {
+        discard_cancelled_jobs();
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Removes a job that was never started from the job list, along with the
+ * command kept to start it.
+ *
+ * jid - the job id of the job
+ */
+void discard_queued_job(int jid) {
+    queued_command_t *queued = get_queued_data(job_list, jid);
+    if (queued != NULL) {
+        free_tree(queued->node);
+        free_tree(queued->function);
+        free(queued);
+    }
+    remove_job_jid(job_list, jid);
+}
+
+/*
+ * Drops the cancelled jobs, which needed a job to succeed when it did not.
+ * That in turn counts as a failure for the jobs waiting for those.
+ */
+void discard_cancelled_jobs() {
+    int cancelled;
+    while ((cancelled = find_job_jid(job_list, CANCELLED)) != -1) {
+        discard_queued_job(cancelled);
+        if (interactive && printf("[%d] cancelled\n", cancelled) < 0) {
+            perror("printf");
+        }
+        release_jobs(job_list, cancelled, 0);
+    }
+}
+
+/*
+ * Lets the jobs waiting for a job that has finished go ahead, and drops the
+ * ones that needed it to succeed when it did not.
+ *
+ * jid - the job id of the finished job
+ * status - the status filled in by waitpid for it
+ */
+void release_dependents(int jid, int status) {
+    release_jobs(job_list, jid, WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    discard_cancelled_jobs();
+}
+
+/*
+ * Starts a queued job in a child of its own and marks it as running.
+ * Returns the process id of the job, or -1 if it is not queued.
+ *
+ * jid - the job id of the queued job
+ */
+pid_t start_queued_job(int jid) {
+    queued_command_t *queued = get_queued_data(job_list, jid);
+    if (queued == NULL) {
+        return -1;
+    }
+    fflush(stdout);
+    // The pipes of the process substitutions pending for the command being
+    // run right now are not this job's
+    int pending_substitutions = substitution_count;
+    substitution_count = 0;
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        cleanup_job_list(job_list);
+        exit(1);
+    }
+    if (pid == 0) {
+        // The shell may be waiting with SIGCHLD blocked, which the job must
+        // not inherit
+        sigset_t child;
+        sigemptyset(&child);
+        sigaddset(&child, SIGCHLD);
+        sigprocmask(SIG_UNBLOCK, &child, NULL);
+        run_child(queued->node, queued->tokens, queued->argv, queued->argc,
+                  queued->assignments, queued->targets, queued->function,
+                  queued->prioritized ? &queued->priority : NULL);
+    }
+    substitution_count = pending_substitutions;
+    start_timeout(pid, queued->prioritized ? &queued->priority : NULL);
+
+    start_job(job_list, jid, pid);
+    if (interactive && printf("[%d] (%d)\n", jid, pid) < 0) {
+        perror("printf");
+    }
+    last_background_pid = pid;
+    free_tree(queued->node);
+    free_tree(queued->function);
+    free(queued);
+    return pid;
+}
+
+/*
+ * Starts queued jobs in the order they were queued for as long as fewer than
+ * maxjobs jobs are running. Stopped jobs do not count against the limit.
+ */
+void start_queued_jobs() {
+    int jid;
+    while ((max_jobs == 0 || count_jobs(job_list, RUNNING) < max_jobs) &&
+           (jid = find_job_jid(job_list, QUEUED)) != -1) {
+        start_queued_job(jid);
+    }
+}
+
+/*
+ * Executes built in after, `after [-s] %jid... -- command [args] &`, which
+ * queues command as a background job that waits for the given jobs to finish
+ * before it is started, and with -s is cancelled unless they all succeed.
+ * Returns 0 if the job was queued, 1 otherwise.
+ *
+ * node - the command node
+ * tokens, argc - the expanded words of the command
+ * assignments - the NAME=value assignments that precede the command
+ * targets - the expanded redirection targets
+ */
+int after_builtin(node_t *node, char *tokens[512], int argc,
+                  char *assignments[512], char *targets[MAX_REDIRECTS]) {
+    int after[512];
+    int after_count = 0;
+    int require_success = 0;
+    int arg = 1;
+    if (arg < argc && strcmp(tokens[arg], "-s") == 0) {
+        require_success = 1;
+        arg++;
+    }
+    for (; arg < argc && tokens[arg][0] == '%'; arg++) {
+        char *end;
+        long jid = strtol(tokens[arg] + 1, &end, 10);
+        if (tokens[arg][1] == '\0' || *end != '\0' || jid < 1 ||
+            jid >= job_counter) {
+            fprintf(stderr, "after: %s: no such job\n", tokens[arg]);
+            return 1;
+        }
+        after[after_count++] = (int)jid;
+    }
+    if (after_count == 0 || arg + 1 >= argc || strcmp(tokens[arg], "--") != 0) {
+        fprintf(stderr, "after: usage: after [-s] %%jid... -- command &\n");
+        return 1;
+    }
+    if (!node->background) {
+        fprintf(stderr, "after: the command has to run in the background\n");
+        return 1;
+    }
+    arg++;
+    job_priority_t low;
+    low_priority(&low);
+    int status = queue_command(node, tokens + arg, argc - arg, assignments,
+                               targets, get_func(func_table, tokens[arg]),
+                               bgnice ? &low : NULL, after, after_count,
+                               require_success);
+    // Jobs that are already done leave nothing to wait for
+    start_queued_jobs();
+    return status;
+}
+
+/*
+ * Runs one command of parallel in the child forked for it. The children stay
+ * in the shell's process group, as parallel waits on them itself, so only
+ * the keyboard interrupt is restored for them to be stopped from the
+ * terminal. Never returns.
+ *
+ * argv - the argument vector of the command
+ */
+void run_parallel_job(char *argv[]) {
+    if (interactive && signal(SIGINT, SIG_DFL) == SIG_ERR) {
+        perror("signal");
+        exit(1);
+    }
+    close_command_fds();
+    exec_command(argv[0], argv, get_envp(var_table));
+    int error = errno;
+    perror(argv[0]);
+    exit(error == ENOENT ? 127 : 126);
+}
+
+/*
+ * Executes built in parallel, which runs a command for each of its inputs
+ * with at most a given number of them at once.
+ * Returns the number of commands that failed.
+ *
+ * argv - input argument vector
+ * argc - argument counter
+ */
+int parallel_builtin(char *argv[], int argc) {
+    return parallel(argv, argc, run_parallel_job);
+}
+
+/*
+ * Runs a command in a child of its own, waiting for it in the foreground or
+ * adding it to the job list in the background, where it is queued instead
+ * while maxjobs jobs are running.
+ * Returns the exit status of a foreground command, 0 for a background job.
+ *
+ * node - the command node
+ * tokens, argv, argc - the expanded words of the command
+ * assignments - the NAME=value assignments that precede the command
+ * targets - the expanded redirection targets
+ * function - the shell function the command calls, or NULL
+ * priority - how to schedule the command, or NULL to leave it as it is
+ */
+int spawn_command(node_t *node, char *tokens[], char *argv[], int argc,
+                  char *assignments[], char *targets[], node_t *function,
+                  const job_priority_t *priority) {
+    int status = 0;
+    if (node->background && max_jobs > 0 && substitution_count == 0 &&
+        (count_jobs(job_list, RUNNING) >= max_jobs ||
+         find_job_jid(job_list, QUEUED) != -1)) {
+        // Jobs beyond the limit wait their turn behind any queued earlier.
+        // Commands with process substitutions are started right away, as
+        // their helpers are already running.
+        return queue_command(node, tokens, argc, assignments, targets,
+                             function, priority, NULL, 0, 0);
+    }
+    // Output the shell buffered for a pipe or file must not be written
+    // a second time by the child
+    fflush(stdout);
+    // Execute child process
+    pid_t child_pid = fork();
+    if (child_pid == -1) {
+        perror("fork");
+        cleanup_job_list(job_list);
+        exit(1);
+    }
+    if (child_pid == 0) {
+        run_child(node, tokens, argv, argc, assignments, targets, function,
+                  priority);
+    }
+    start_timeout(child_pid, priority);
+    if (node->background) {
+        if (add_job(job_list, job_counter, child_pid, RUNNING, tokens[0]) ==
+            -1) {
+            fprintf(stderr, "add background job error");
+        }
+        if (interactive && printf("[%d] (%d)\n", job_counter, child_pid) < 0) {
+            perror("printf");
+        }
+        job_counter++;
+        last_background_pid = child_pid;
+    } else {
+        // Abstract Out Foreground Process Handler
+        post_foreground_handler(child_pid, tokens[0]);
+        status = last_status;
+    }
+    // Reap background jobs as commands finish, even in the middle of a
+    // long running loop
+    process_handler();
+    return status;
+}
+
+/*
+ * Executes built in sched, `sched [options] command [args]`, which runs
+ * command in a child of its own with the CPU affinity, niceness, scheduling
+ * policy and I/O class given by the options, as read by parse_priority.
+ * Background jobs start from the low priority class under set -o bgnice.
+ * Returns the exit status of the command, or 1 on a syntax error.
+ *
+ * node - the command node
+ * tokens, argv, argc - the expanded words of the command
+ * assignments - the NAME=value assignments that precede the command
+ * targets - the expanded redirection targets
+ */
+int sched_builtin(node_t *node, char *tokens[512], char *argv[512], int argc,
+                  char *assignments[512], char *targets[MAX_REDIRECTS]) {
+    job_priority_t priority;
+    if (bgnice && node->background) {
+        low_priority(&priority);
+    } else {
+        init_priority(&priority);
+    }
+    int first = parse_priority(tokens, argc, &priority);
+    if (first == -1) {
+        return 1;
+    }
+    if (first == argc) {
+        fprintf(stderr, "sched: usage: sched [-c cpus] [-n nice] "
+                        "[-p policy] [-o class[:level]] command\n");
+        return 1;
+    }
+    // argv names the program without its path, as expand_command left it
+    char *name = strrchr(tokens[first], '/');
+    argv[first] = name != NULL ? name + 1 : tokens[first];
+    return spawn_command(node, tokens + first, argv + first, argc - first,
+                         assignments, targets,
+                         get_func(func_table, tokens[first]), &priority);
+}
+
+/*
+ * Executes built in ulimit, which prints or sets the resource limits of the
+ * shell, and so of every command it starts, as read by parse_ulimit. Given
+ * -- command, the limits are set for that command alone instead, which runs
+ * in a child of its own.
+ * Returns the exit status of the command, or of the builtin without one.
+ *
+ * node - the command node
+ * tokens, argv, argc - the expanded words of the command
+ * assignments - the NAME=value assignments that precede the command
+ * targets - the expanded redirection targets
+ */
+int ulimit_builtin(node_t *node, char *tokens[512], char *argv[512], int argc,
+                   char *assignments[512], char *targets[MAX_REDIRECTS]) {
+    ulimit_args_t args;
+    if (parse_ulimit(tokens, argc, &args) == -1) {
+        return 1;
+    }
+    if (args.command != 0) {
+        int first = args.command;
+        job_priority_t priority;
+        if (bgnice && node->background) {
+            low_priority(&priority);
+        } else {
+            init_priority(&priority);
+        }
+        memcpy(priority.limits, args.limits, sizeof(args.limits));
+        priority.limit_count = args.limit_count;
+        // argv names the program without its path, as expand_command left it
+        char *name = strrchr(tokens[first], '/');
+        argv[first] = name != NULL ? name + 1 : tokens[first];
+        return spawn_command(node, tokens + first, argv + first, argc - first,
+                             assignments, targets,
+                             get_func(func_table, tokens[first]), &priority);
+    }
+    if (apply_limits(args.limits, args.limit_count, 0) == -1 ||
+        print_limits(&args) == -1) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Executes built in timeout,
+ *   timeout [-s signal] [-k grace] duration [-s signal] command [args]
+ * which runs command in a child of its own and sends it signal, SIGTERM by
+ * default, once it has run for duration, followed by SIGKILL grace later if
+ * it is still around, 5 seconds by default and never with -k 0. The command
+ * gets a process group of its own, so the signals reach all of its processes.
+ * Returns the exit status of the command, which is 124 if its timeout killed
+ * it in the foreground, or 125 on a syntax error, like timeout(1).
+ *
+ * node - the command node
+ * tokens, argv, argc - the expanded words of the command
+ * assignments - the NAME=value assignments that precede the command
+ * targets - the expanded redirection targets
+ */
+int timeout_builtin(node_t *node, char *tokens[512], char *argv[512], int argc,
+                    char *assignments[512], char *targets[MAX_REDIRECTS]) {
+    job_priority_t priority;
+    if (bgnice && node->background) {
+        low_priority(&priority);
+    } else {
+        init_priority(&priority);
+    }
+    priority.timeout_grace = 5000000000LL;
+    int have_duration = 0;
+    int first = 1;
+    for (; first < argc; first++) {
+        char *option = tokens[first];
+        if (strcmp(option, "-s") != 0 && strcmp(option, "-k") != 0) {
+            // The first other word is the duration, the next the command
+            if (have_duration) {
+                break;
+            }
+            if (parse_duration(option, &priority.timeout) == -1) {
+                fprintf(stderr, "timeout: %s: invalid duration\n", option);
+                return 125;
+            }
+            have_duration = 1;
+        } else if (first + 1 == argc) {
+            fprintf(stderr, "timeout: %s: missing value\n", option);
+            return 125;
+        } else if (option[1] == 's' &&
+                   (priority.timeout_signal = parse_signal(tokens[++first])) ==
+                       -1) {
+            fprintf(stderr, "timeout: %s: invalid signal\n", tokens[first]);
+            return 125;
+        } else if (option[1] == 'k' &&
+                   parse_duration(tokens[++first], &priority.timeout_grace) ==
+                       -1) {
+            fprintf(stderr, "timeout: %s: invalid duration\n", tokens[first]);
+            return 125;
+        }
+    }
+    if (first == argc) {
+        fprintf(stderr, "timeout: usage: timeout [-s signal] [-k grace] "
+                        "duration command\n");
+        return 125;
+    }
+    // argv names the program without its path, as expand_command left it
+    char *name = strrchr(tokens[first], '/');
+    argv[first] = name != NULL ? name + 1 : tokens[first];
+    return spawn_command(node, tokens + first, argv + first, argc - first,
+                         assignments, targets,
+                         get_func(func_table, tokens[first]), &priority);
+}
+
+/*
+ * Runs a single simple command, either through a builtin, a shell function or
+ * in a child process that is waited on or added to the job list as a
+ * background job. Functions are called in the shell itself unless they are
+ * run in the background or with redirections or assignments, which need a
+ * child of their own.
+ * Returns the exit status of the command.
+ *
+ * node - the simple command to run
+ */
+int run_command(node_t *node) {
+    char *tokens[512];
+    char *argv[512];
+    // NAME=value assignments that precede the command
+    char *assignments[512];
+    // Expanded redirection paths and descriptors
+    char *redirect_targets[MAX_REDIRECTS];
+    node_t *function = NULL;
+    builtin_t builtin;
+    job_priority_t low;
+    int status = 0;
+
+    // Expanded words of the previous command are no longer referenced
+    reset_arena(expansion_arena);
+    substitution_status = -1;
+    // A background command becomes the next job, which its process
+    // substitutions are reaped with
+    substitution_jid = node->background ? job_counter : 0;
+    int argc = expand_command(node, tokens, argv, assignments);
+    if (argc == -1) {
+        return 1;
+    }
+    for (int i = 0; i < node->redirect_count; i++) {
+        redirect_targets[i] = node->redirects[i].target;
+        if (node->redirects[i].type != REDIRECT_HEREDOC_QUOTED &&
+            (redirect_targets[i] = expand_word(redirect_targets[i])) == NULL) {
+            return 1;
+        }
+    }
+
+    char *built_in = tokens[0];
+    if (built_in == NULL) {
+        // A command of only assignments sets shell variables, and reports
+        // the status of its last command substitution
+        status = assign_vars(assignments, 0);
+        return status == 0 && substitution_status != -1 ? substitution_status
+                                                        : status;
+    }
+    low_priority(&low);
+    // Check if the first token matches built ins and handle appropriately
+    if (strcmp(built_in, "exit") == 0) {
+        exit_builtin(argv, argc);
+    } else if (strcmp(built_in, "exec") == 0) {
+        status = exec_builtin(node, tokens, assignments, redirect_targets);
+    } else if (strcmp(built_in, "cd") == 0) {
+        status = cd(argv, argc);
+    } else if (strcmp(built_in, "ln") == 0) {
+        status = ln(argv, argc);
+    } else if (strcmp(built_in, "rm") == 0) {
+        status = rm(argv, argc);
+    } else if (strcmp(built_in, "sched") == 0) {
+        status = sched_builtin(node, tokens, argv, argc, assignments,
+                               redirect_targets);
+    } else if (strcmp(built_in, "ulimit") == 0) {
+        status = ulimit_builtin(node, tokens, argv, argc, assignments,
+                                redirect_targets);
+    } else if (strcmp(built_in, "timeout") == 0) {
+        status = timeout_builtin(node, tokens, argv, argc, assignments,
+                                 redirect_targets);
+    } else if (strcmp(built_in, "set") == 0) {
+        status = set_builtin(argv, argc);
+    } else if (strcmp(built_in, "after") == 0) {
+        status = after_builtin(node, tokens, argc, assignments,
+                               redirect_targets);
+    } else if (!node->background && strcmp(built_in, "parallel") == 0) {
+        status = run_redirected(parallel_builtin, node, argv, argc,
+                                redirect_targets);
+    } else if (!node->background &&
+               (builtin = find_builtin(built_in, argv, argc)) != NULL &&
+               (builtin != cat_builtin || !interactive ||
+                reads_regular_files(node, argv, argc, redirect_targets))) {
+        status = run_redirected(builtin, node, argv, argc, redirect_targets);
+    } else if (strcmp(built_in, "test") == 0 || strcmp(built_in, "[") == 0) {
+        status = test_builtin(argv, argc);
+    } else if (strcmp(built_in, "break") == 0 ||
+               strcmp(built_in, "continue") == 0) {
+        status = loop_control(argv, argc);
+    } else if (strcmp(built_in, "export") == 0) {
+        status = export_builtin(argv, argc);
+    } else if (strcmp(built_in, "unset") == 0) {
+        status = unset_builtin(argv, argc);
+    } else if (strcmp(built_in, "jobs") == 0) {
+        status = jobs_builtin(argv, argc);
+    } else if (strcmp(built_in, "maxjobs") == 0) {
+        status = maxjobs_builtin(argv, argc);
+    } else if (strcmp(built_in, "bg") == 0) {
+        status = bg(argv, argc);
+    } else if (strcmp(built_in, "fg") == 0) {
+        status = fg(argv, argc);
+    } else if (strcmp(built_in, "return") == 0) {
+        status = return_builtin(argv, argc);
+    } else if (strcmp(built_in, "shift") == 0) {
+        status = shift(argv, argc);
+    } else if (strcmp(built_in, "source") == 0 ||
+               strcmp(built_in, ".") == 0) {
+        status = source_builtin(argv, argc);
+    } else if ((function = get_func(func_table, built_in)) != NULL &&
+               !node->background && node->redirect_count == 0 &&
+               assignments[0] == NULL) {
+        status = call_function(function, argv, argc);
+    } else {
+        status = spawn_command(node, tokens, argv, argc, assignments,
+                               redirect_targets, function,
+                               bgnice && node->background ? &low : NULL);
+    }
+    return status;
+}
+
+/*
+ * Runs each command of a list in turn, stopping early for break, continue
+ * or a foreground job interrupted from the keyboard.
+ * Returns the exit status of the last command run.
+ *
+ * list - the first node of the list
+ */
+int run_list(node_t *list) {
+    for (node_t *node = list; node != NULL; node = node->next) {
+        run_node(node);
+        if (breaking || continuing || abort_execution || returning) {
+            break;
+        }
+    }
+    return last_status;
+}
+
+/*
+ * Runs a while loop. The condition and body are executed straight from the
+ * tree, so no iteration goes back through the parser.
+ * Returns the exit status of the last body command, or 0 if none ran.
+ *
+ * node - the NODE_WHILE node
+ */
+int run_while(node_t *node) {
+    int status = 0;
+    loop_depth++;
+    while (1) {
+        run_list(node->condition);
+        if (stop_loop() || last_status != 0) {
+            break;
+        }
+        status = run_list(node->body);
+        if (stop_loop()) {
+            break;
+        }
+    }
+    loop_depth--;
+    return status;
+}
+
+/*
+ * Runs a for loop. The word list is expanded and split once up front and
+ * copied, since the body reuses the expansion buffer. Without a word list the
+ * loop runs over the positional parameters.
+ * Returns the exit status of the last body command, or 0 if none ran.
+ *
+ * node - the NODE_FOR node
+ */
+int run_for(node_t *node) {
+    int status = 0;
+    int value_count = 0;
+    char *fields[512];
+    reset_arena(expansion_arena);
+    if (node->words == NULL) {
+        for (int i = 0; i < positional_count && i < 512; i++) {
+            fields[value_count++] = positional_params[i];
+        }
+    }
+    for (int i = 0; i < node->word_count; i++) {
+        char *word = expand_word(node->words[i]);
+        int added;
+        if (word == NULL ||
+            (added = split_fields(node->words[i], word, fields, value_count,
+                                  512)) == -1) {
+            if (word != NULL) {
+                fprintf(stderr, "error: too many arguments\n");
+            }
+            status = 1;
+            break;
+        }
+        value_count += added;
+    }
+    char **values = (char **)calloc((size_t)value_count + 1, sizeof(char *));
+    if (values == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    for (int i = 0; i < value_count; i++) {
+        if ((values[i] = strdup(fields[i])) == NULL) {
+            perror("strdup");
+            status = 1;
+            value_count = i;
+            break;
+        }
+    }
+
+    loop_depth++;
+    for (int i = 0; status == 0 && i < value_count; i++) {
+        if (set_var(var_table, node->name, values[i], 0) == -1) {
+            fprintf(stderr, "error assigning %s\n", node->name);
+            status = 1;
+            break;
+        }
+        status = run_list(node->body);
+        if (stop_loop()) {
+            break;
+        }
+    }
+    loop_depth--;
+
+    for (int i = 0; i < value_count; i++) {
+        free(values[i]);
+    }
+    free(values);
+    return status;
+}
+
+/*
+ * Runs a single node of a command tree, recording its exit status for $?.
+ * Returns that exit status.
+ *
+ * node - the node to run
+ */
+int run_node(node_t *node) {
+    switch (node->type) {
+        case NODE_COMMAND: {
+            // Process substitutions are only needed until the command starts
+            int first_substitution = substitution_count;
+            last_status = run_command(node);
+            finish_substitutions(first_substitution);
+            break;
+        }
+        case NODE_AND:
+        case NODE_OR:
+            run_list(node->condition);
+            // && runs its right side on success, || on failure
+            if (!breaking && !continuing && !abort_execution && !returning &&
+                (last_status == 0) == (node->type == NODE_AND)) {
+                run_list(node->body);
+            }
+            break;
+        case NODE_IF:
+            run_list(node->condition);
+            if (breaking || continuing || abort_execution || returning) {
+                break;
+            }
+            if (last_status == 0) {
+                run_list(node->body);
+            } else if (node->else_body != NULL) {
+                run_list(node->else_body);
             } else {
-                // Execute child process
-                pid_t child_pid = fork();
-                if (child_pid == -1) {
-                    perror("fork");
-                    cleanup_job_list(job_list);
-                    exit(1);
-                }
-                if (child_pid == 0) {
-                    // Find the unique Process id
-                    if (setpgid(0, 0) == -1) {
-                        perror("setpgid");
-                        exit(1);
-                    }
-                    // If the process is not running in the background, set
-                    // the controlling terminal
-                    if (!background_flag) {
-                        if (tcsetpgrp(0, getpgrp()) == -1) {
-                            perror("tcsetpgrp");
-                            exit(1);
-                        }
-                    }
-
-                    // Restore the following Signals to default
-                    if (signal(SIGINT, SIG_DFL) == SIG_ERR) {
-                        perror("signal");
-                        cleanup_job_list(job_list);
-                        exit(1);
-                    }
-                    if (signal(SIGTSTP, SIG_DFL) == SIG_ERR) {
-                        perror("signal");
-                        cleanup_job_list(job_list);
-                        exit(1);
-                    }
-                    if (signal(SIGTTOU, SIG_DFL) == SIG_ERR) {
-                        perror("signal");
-                        cleanup_job_list(job_list);
-                        exit(1);
-                    }
-
-                    io_redirection(&input_redirect_path, &output_redirect_path,
-                                   &output_append_path);
-                    execv(tokens[0], argv);
-                    perror("execv");
-
-                    exit(1);
-                } else {
-                    if (background_flag) {
-                        if (add_job(job_list, job_counter, child_pid, RUNNING,
-                                    built_in) == -1) {
-                            fprintf(stderr, "add background job error");
-                        }
-                        if (printf("[%d] (%d)\n", job_counter, child_pid) < 0) {
-                            perror("printf");
-                        }
-                        job_counter++;
-                    } else {
-                        // Abstract Out Foreground Process Handler
-                        post_foreground_handler(child_pid, built_in);
-                    }
-                    background_flag = 0;
-                }
+                last_status = 0;
+            }
+            break;
+        case NODE_WHILE:
+            last_status = run_while(node);
+            break;
+        case NODE_FOR:
+            last_status = run_for(node);
+            break;
+        case NODE_GROUP:
+            run_list(node->body);
+            break;
+        case NODE_FUNCTION:
+            if (define_func(func_table, node->name, node->body) == -1) {
+                fprintf(stderr, "error defining %s\n", node->name);
+                last_status = 1;
+            } else {
+                last_status = 0;
+            }
+            break;
+    }
+    return last_status;
+}
+
+/*
+ * Parses and runs every complete line of text in turn, so that each line can
+ * use the functions and variables defined by the ones before it.
+ * Returns how many characters were consumed, anything after that is a
+ * partial command that needs more text.
+ *
+ * src - the text to run, which does not have to be NUL terminated
+ * length - the number of characters in src
+ * at_eof - nonzero if no more text will follow
+ */
+size_t run_text(const char *src, size_t length, int at_eof) {
+    parser_t parser;
+    node_t *tree;
+    parse_result_t result;
+    init_parser(&parser, src, length, at_eof);
+    while ((result = parse_next(&parser, &tree)) == PARSE_OK ||
+           result == PARSE_ERROR) {
+        if (result == PARSE_ERROR) {
+            last_status = 2;
+            continue;
+        }
+        abort_execution = 0;
+        reset_glob_cache(glob_cache);
+        run_list(tree);
+        free_tree(tree);
+    }
+    return parser.pos;
+}
+
+/*
+ * Parses and runs every complete line held in the input buffer, then moves
+ * any trailing partial command to the front of the buffer so that the next
+ * read can complete it.
+ *
+ * input - the buffer of text read but not yet run
+ * input_length - pointer to the number of characters in input
+ * at_eof - nonzero if no more input will follow
+ */
+void run_input(char *input, size_t *input_length, int at_eof) {
+    size_t consumed = run_text(input, *input_length, at_eof);
+    memmove(input, input + consumed, *input_length - consumed);
+    *input_length -= consumed;
+}
+
+/*
+ * Runs a script file, parsing it straight out of a read only mapping of the
+ * file instead of copying it through read buffers. Files with a NUL byte in
+ * their first line are refused as binaries.
+ * Returns 0 on success, -1 after reporting an error if it could not be read.
+ *
+ * path - the path of the script
+ */
+int run_script(char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) == -1) {
+        perror(path);
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (info.st_size > 0) {
+        void *src =
+            mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (src == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return -1;
+        }
+        close(fd);
+        size_t line = (size_t)info.st_size < 256 ? (size_t)info.st_size : 256;
+        const char *newline = memchr(src, '\n', line);
+        if (newline != NULL) {
+            line = (size_t)(newline - (const char *)src);
+        }
+        if (memchr(src, '\0', line) != NULL) {
+            fprintf(stderr, "%s: cannot execute binary file\n", path);
+            munmap(src, (size_t)info.st_size);
+            return -1;
+        }
+        run_text((const char *)src, (size_t)info.st_size, 1);
+        munmap(src, (size_t)info.st_size);
+        return 0;
+    }
+    close(fd);
+    return 0;
+}
+
+/*
+ * Makes a list of arguments the positional parameters of the shell, replacing
+ * the current ones. Returns 0 on success and -1 on failure.
+ *
+ * args - the arguments, which are copied
+ * count - the number of arguments
+ */
+int set_positional_params(char **args, int count) {
+    char **params = (char **)calloc((size_t)count + 1, sizeof(char *));
+    if (params == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if ((params[i] = strdup(args[i])) == NULL) {
+            perror("strdup");
+            for (int j = 0; j < i; j++) {
+                free(params[j]);
+            }
+            free(params);
+            return -1;
+        }
+    }
+    for (int i = 0; i < positional_count; i++) {
+        free(positional_params[i]);
+    }
+    free(positional_params);
+    positional_params = params;
+    positional_count = count;
+    return 0;
+}
+
+/*
+ * Prints the prompt, or the continuation prompt while a command spanning
+ * several lines is being read.
+ *
+ * continuation - nonzero if the previous line left a command unfinished
+ */
+void print_prompt(int continuation) {
+    if (!show_prompt) {
+        return;
+    }
+    if (printf(continuation ? "> " : "33sh> ") < 0) {
+        fprintf(stderr, "Error printing prompt to terminal");
+    }
+    if (fflush(stdout) < 0) {
+        fprintf(stderr, "Error flushing printing terminal prompt");
+    }
+}
+
+/*
+ * Waits for standard input to become readable while jobs are queued, wait
+ * for other jobs or have deadlines pending. SIGCHLD is blocked and read from
+ * a signalfd in the meantime, so running jobs are reaped as soon as they
+ * finish and the jobs they release started, and the signals of deadlines
+ * are sent as they come due, rather than once the next line has been read.
+ */
+void wait_for_input() {
+    if (!watching_jobs()) {
+        return;
+    }
+    sigset_t previous;
+    int signal_fd = block_child_signal(&previous);
+    // Without the signalfd, the jobs are checked on every so often instead
+    struct pollfd fds[3] = {
+        {.fd = 0, .events = POLLIN, .revents = 0},
+        {.fd = timer_fd(timers), .events = POLLIN, .revents = 0},
+        {.fd = signal_fd, .events = POLLIN, .revents = 0}};
+    // Children that finished before SIGCHLD was blocked are reaped first
+    process_handler();
+    while (watching_jobs()) {
+        if (poll(fds, 3, signal_fd == -1 ? 100 : -1) == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            perror("poll");
+            break;
+        }
+        if (fds[0].revents != 0) {
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            expire_timers(timers);
+        }
+        if (fds[2].revents & POLLIN) {
+            drain_child_signal();
         }
         process_handler();
-        argc = 0;
-        // Create a variable to track output redirection with append
-        output_append_path = NULL;
-        // Create a variable to track output redirection file path
-        output_redirect_path = NULL;
-        // Create a variable to track input redirect file path
-        input_redirect_path = NULL;
-
-#ifdef PROMPT
-        if (printf("33sh> ") < 0) {
-            fprintf(stderr, "Error printing prompt to terminal");
-        }
-        if (fflush(stdout) < 0) {
-            fprintf(stderr, "Error flushing printing terminal prompt");
-        }
-#endif
-        // Reset all arrays
-        memset(buffer, 0, 1024);
-        memset(tokens, 0, 512 * sizeof(char *));
-        memset(argv, 0, 512 * sizeof(char *));
+    }
+    sigprocmask(SIG_SETMASK, &previous, NULL);
+}
+
+/*
+ * Reads commands from standard input until it is closed, running each line
+ * as soon as it is complete and prompting for more when interactive.
+ */
+
+void run_stdin() {
+    char buffer[65536];
+    // A terminal hands over one line per read anyway, but a pipe or file is
+    // read in large chunks to keep the number of reads down
+    size_t read_size = interactive ? count : sizeof(buffer);
+    ssize_t input_bytes_read;
+    // Text that has been read but not run yet, which can hold the first
+    // lines of a command that spans several lines
+    char *input = NULL;
+    size_t input_length = 0;
+    size_t input_capacity = 0;
+
+    print_prompt(0);
+    wait_for_input();
+    while ((input_bytes_read = read(0, buffer, read_size)) != 0) {
+        // check for read error
+        if (input_bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            break;
+        }
+        // Add the new text to whatever is left over from earlier reads
+        if (input_length + (size_t)input_bytes_read > input_capacity) {
+            input_capacity = 2 * (input_length + (size_t)input_bytes_read);
+            char *grown = (char *)realloc(input, input_capacity);
+            if (grown == NULL) {
+                perror("realloc");
+                break;
+            }
+            input = grown;
+        }
+        memcpy(input + input_length, buffer, (size_t)input_bytes_read);
+        input_length += (size_t)input_bytes_read;
+        run_input(input, &input_length, 0);
+
+        process_handler();
+        print_prompt(input_length > 0);
+        wait_for_input();
+    }
+    // Run whatever is left once the input is closed
+    if (input_length > 0) {
+        run_input(input, &input_length, 1);
+    }
+    free(input);
+}
+
+/*
+ * Runs the commands given with -c, the script named by the first argument or
+ * else the commands read from standard input. Whether the shell is
+ * interactive is decided here, once, from whether standard input is a
+ * terminal. Being invoked as 33noprompt turns off the prompt, and on standard
+ * input the limit on background jobs as well.
+ *
+ * argc - number of arguments
+ * argv - 33sh [-c commands [name [args...]] | script [args...]]
+ */
+int main(int argc, char *argv[]) {
+    char *command_string = NULL;
+    char *script_path = NULL;
+    int first_param = argc;
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: -c: option requires an argument\n", argv[0]);
+            exit(2);
+        }
+        command_string = argv[2];
+        // The argument after the commands, if any, is their $0
+        if (argc > 3) {
+            shell_name = argv[3];
+            first_param = 4;
+        }
+    } else if (argc > 1) {
+        script_path = argv[1];
+        shell_name = argv[1];
+        first_param = 2;
+    } else if (argc == 1) {
+        shell_name = argv[0];
+    }
+    interactive = command_string == NULL && script_path == NULL && isatty(0);
+    char *invoked_as = argc > 0 ? strrchr(argv[0], '/') : NULL;
+    int noprompt = argc > 0 &&
+                   strcmp(invoked_as != NULL ? invoked_as + 1 : argv[0],
+                          "33noprompt") == 0;
+    show_prompt = interactive && !noprompt;
+    // The job control traces run 33noprompt and expect all of the jobs they
+    // start with & to run at once, however few CPUs there are
+    if (command_string != NULL || script_path != NULL || !noprompt) {
+        max_jobs = online_cpus();
+    }
+
+    // Descriptors the shell inherited are not passed on to its commands.
+    // Marking them close-on-exec here once spares every command's child
+    // from closing them itself.
+    if (close_range(3, ~0U, CLOSE_RANGE_CLOEXEC) == -1) {
+        inherited_fds = 1;
+    }
+    // Create the jobs list
+    job_list = init_job_list();
+    shell_pid = getpid();
+    // Import the inherited environment as exported shell variables
+    var_table = init_var_table(environ);
+    func_table = init_func_table();
+    expansion_arena = init_arena();
+    script_cache = init_script_cache();
+    glob_cache = init_glob_cache();
+    if ((timers = init_timer_heap()) == NULL) {
+        perror("timerfd_create");
+        cleanup_job_list(job_list);
+        exit(1);
+    }
+    if (set_positional_params(argv + first_param, argc - first_param) == -1) {
+        cleanup_job_list(job_list);
+        exit(1);
+    }
+    // Job Id
+    // Ignore the following Signals by default, only an interactive shell
+    // has to survive the keyboard signals meant for its foreground job
+    if (interactive) {
+        if (signal(SIGINT, SIG_IGN) == SIG_ERR) {
+            perror("signal");
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+        if (signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+            perror("signal");
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+        if (signal(SIGTTOU, SIG_IGN) == SIG_ERR) {
+            perror("signal");
+            cleanup_job_list(job_list);
+            exit(1);
+        }
+    }
+
+    if (command_string != NULL) {
+        run_text(command_string, strlen(command_string), 1);
+    } else if (script_path != NULL) {
+        if (run_script(script_path) == -1) {
+            last_status = 127;
+        }
+    } else {
+        run_stdin();
     }
     // Continue to clean job list before every return
     cleanup_job_list(job_list);
-    return 0;
+    cleanup_var_table(var_table);
+    cleanup_func_table(func_table);
+    cleanup_script_cache(script_cache);
+    cleanup_glob_cache(glob_cache);
+    cleanup_timer_heap(timers);
+    cleanup_arena(expansion_arena);
+    return last_status;
 }
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Checks that a job started with after -s runs only once the jobs it waits
+# for have succeeded, whether they are still running or already done.
+#
+# usage: shell_2_tests/after_test.sh [shell]
+
+shell=${1:-./33sh}
+failed=0
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+printf '#!/bin/bash\n/bin/sleep 0.2\nexit 1\n' > "$tmp/fail"
+chmod +x "$tmp/fail"
+
+# Runs the script in the shell and compares what it prints with expected
+check_output() {
+    local name=$1 script=$2 expected=$3
+    local actual
+    actual=$("$shell" -c "$script" < /dev/null 2>&1 | tr '\n' ' ')
+    actual=${actual% }
+    if [[ "$actual" == "$expected" ]]; then
+        echo "after_test: $name: PASS"
+    else
+        echo "after_test: $name: FAIL, expected '$expected' but got '$actual'"
+        failed=1
+    fi
+}
+
+check_output "running job succeeds" "/bin/sleep 0.2 &
+after -s %1 -- /bin/echo ran &
+/bin/sleep 0.5" "ran"
+check_output "running job fails" "$tmp/fail &
+after -s %1 -- /bin/echo ran &
+/bin/sleep 0.5
+/bin/echo end" "end"
+check_output "finished job succeeded" "/bin/true &
+/bin/sleep 0.2
+after -s %1 -- /bin/echo ran &
+/bin/sleep 0.2" "ran"
+check_output "finished job failed" "/bin/false &
+/bin/sleep 0.2
+after -s %1 -- /bin/echo ran &
+/bin/echo status \$?
+/bin/sleep 0.2" "status 1"
+
+exit $failed
@@ -0,0 +1,43 @@
+#!/bin/bash
+# Checks that && || and ?: in $(( )) only evaluate the operand they need, so
+# a guard such as b != 0 && 10 / b neither divides by zero nor assigns, and
+# that overflow wraps around instead of crashing the shell.
+#
+# usage: shell_2_tests/arith_test.sh [shell]
+
+shell=${1:-./33sh}
+failed=0
+
+# Runs the script in the shell and compares everything it prints, including
+# errors, with expected
+check_output() {
+    local name=$1 script=$2 expected=$3
+    local actual
+    actual=$("$shell" -c "$script" < /dev/null 2>&1 | tr '\n' ' ')
+    actual=${actual% }
+    if [[ "$actual" == "$expected" ]]; then
+        echo "arith_test: $name: PASS"
+    else
+        echo "arith_test: $name: FAIL, expected '$expected' but got '$actual'"
+        failed=1
+    fi
+}
+
+check_output "guarded division" 'b=0
+/bin/echo $(( b != 0 && 10 / b )) $?' "0 0"
+check_output "skipped assignment" 'x=1
+/bin/echo $(( 0 && (x=5) )) $x' "0 1"
+check_output "taken assignment" 'x=1
+/bin/echo $(( 1 && (x=5) )) $x' "1 5"
+check_output "or" 'b=0
+x=1
+/bin/echo $(( b == 0 || 10 / b )) $(( 1 || (x=7) )) $(( 0 || 3 )) $x' \
+    "1 1 1 1"
+check_output "conditional" 'b=0
+x=1
+/bin/echo $(( b ? 10 / b : (x=2) )) $(( 1 ? 4 : 1 / 0 )) $x' "2 4 2"
+check_output "overflow" 'm=-9223372036854775807
+/bin/echo $(( (m-1) / -1 )) $(( (m-1) % -1 )) $(( m - 2 )) $(( 1 << 64 ))' \
+    "-9223372036854775808 0 9223372036854775807 1"
+
+exit $failed
@@ -0,0 +1,37 @@
+#!/bin/bash
+# Checks the descriptors a command started by the shell is left with. It
+# should see 0 to 2 and its own redirections, plus anything exec opened in
+# the shell, but none of the descriptors the shell inherited or uses itself.
+#
+# usage: shell_2_tests/fd_test.sh [shell]
+
+shell=${1:-./33sh}
+failed=0
+
+# Runs the setup commands in the shell, which has descriptors 7 and 9
+# inherited from this script, then starts a sleep in the background with the
+# given redirections and compares the descriptors it has open with expected
+check_fds() {
+    local name=$1 setup=$2 redirections=$3 expected=$4
+    local actual
+    actual=$("$shell" -c "$setup
+/bin/sleep 1 $redirections &
+/bin/sleep 0.2
+/bin/ls /proc/\$!/fd" 7< /dev/null 9> /dev/null 2>&1 | tr '\n' ' ')
+    actual=${actual% }
+    if [[ "$actual" == "$expected" ]]; then
+        echo "fd_test: $name: PASS"
+    else
+        echo "fd_test: $name: FAIL, expected '$expected' but got '$actual'"
+        failed=1
+    fi
+}
+
+check_fds "no redirections" "" "" "0 1 2"
+check_fds "here-string" "" "<<< text" "0 1 2"
+check_fds "explicit redirections" "" "4< /dev/null 6> /dev/null" "0 1 2 4 6"
+check_fds "exec" "exec 5< /dev/null" "" "0 1 2 5"
+check_fds "exec closed" "exec 5< /dev/null
+exec 5<&-" "" "0 1 2"
+
+exit $failed
@@ -0,0 +1,70 @@
+#!/bin/bash
+# Checks the system calls a non-interactive shell spends on each command it
+# runs. A command should cost the shell no more than a fork and a wait and the
+# child nothing but its execve, with no process group or terminal handoff and
+# no signal handler resets anywhere.
+#
+# usage: shell_2_tests/syscall_test.sh [shell]
+
+shell=${1:-./33sh}
+# Most system calls allowed per command, counting the shell and the child
+# up to its execve
+max_per_command=4
+commands=50
+
+if ! command -v strace > /dev/null; then
+    echo "syscall_test: strace not found, skipping"
+    exit 0
+fi
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Traces the shell running n commands and prints the number of system calls
+# made by the shell and by its children before they exec, followed by the
+# number of those that hand off the terminal or touch signal handlers
+trace_commands() {
+    local script=""
+    for ((i = 0; i < $1; i++)); do
+        script+="/bin/true"$'\n'
+    done
+    strace -f -qq -o "$tmp/trace.$1" "$shell" -c "$script" \
+        < /dev/null > /dev/null 2>&1
+    awk '
+        NR == 1 { shell = $1 }
+        $2 ~ /^(\+\+\+|---)/ { next }
+        {
+            # A call interrupted by another process is logged twice
+            if (($1 == shell || !($1 in execed)) && !/resumed>/) {
+                count++
+                if (/setpgid|TIOCSPGRP|rt_sigaction/) {
+                    handoff++
+                }
+            }
+            if ($1 != shell && /execve/ && / = 0$/) {
+                execed[$1] = 1
+            }
+        }
+        END { print count + 0, handoff + 0 }
+    ' "$tmp/trace.$1"
+}
+
+read -r base base_handoff <<< "$(trace_commands 1)"
+read -r total total_handoff <<< "$(trace_commands $((commands + 1)))"
+if (( base == 0 || total <= base )); then
+    echo "syscall_test: FAIL, could not make sense of the trace"
+    exit 1
+fi
+spent=$(( total - base ))
+
+echo "syscall_test: $spent system calls for $commands commands"
+if (( base_handoff != 0 || total_handoff != 0 )); then
+    echo "syscall_test: FAIL, job control calls made without a terminal"
+    exit 1
+fi
+# The total is compared rather than the rounded down average, so a call made
+# every other command is not lost to the division
+if (( spent > max_per_command * commands )); then
+    echo "syscall_test: FAIL, more than $max_per_command per command"
+    exit 1
+fi
+echo "syscall_test: PASS"
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Checks that timeout stops a job at its deadline with status 124, and that
+# with -k a job ignoring the signal is killed once the grace period is over.
+#
+# usage: shell_2_tests/timeout_test.sh [shell]
+
+shell=${1:-./33sh}
+failed=0
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+printf '#!/bin/bash\ntrap "" TERM\n/bin/sleep 5\n' > "$tmp/ignore"
+chmod +x "$tmp/ignore"
+
+# Runs the script in the shell and compares what it prints, with the job's
+# PID left out of its report, with expected
+check_output() {
+    local name=$1 script=$2 expected=$3
+    local actual
+    actual=$(timeout 10 "$shell" -c "$script" < /dev/null 2>&1 |
+        sed 's/^([0-9]*) //' | tr '\n' ' ')
+    actual=${actual% }
+    if [[ "$actual" == "$expected" ]]; then
+        echo "timeout_test: $name: PASS"
+    else
+        echo "timeout_test: $name: FAIL, expected '$expected' but got" \
+            "'$actual'"
+        failed=1
+    fi
+}
+
+check_output "deadline" "timeout 0.3 /bin/sleep 5
+/bin/echo \$?" "terminated by signal 15 (timed out) 124"
+check_output "kill after grace" "timeout -k 0.2 0.2 $tmp/ignore
+/bin/echo \$?" "terminated by signal 9 (timed out) 124"
+check_output "in time" "timeout 5 /bin/true
+/bin/echo \$?" "0"
+
+exit $failed
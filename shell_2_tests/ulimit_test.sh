@@ -0,0 +1,22 @@
+#!/bin/bash
+# Checks that a job given a CPU time limit with ulimit -t is stopped once it
+# has used it up, and that its end is reported as the CPU limit.
+#
+# usage: shell_2_tests/ulimit_test.sh [shell]
+
+shell=${1:-./33sh}
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+printf '#!/bin/bash\nwhile :; do :; done\n' > "$tmp/spin"
+chmod +x "$tmp/spin"
+
+# The job's PID is left out of the report
+actual=$(timeout 10 "$shell" -c "ulimit -t 1 -- $tmp/spin
+/bin/echo \$?" < /dev/null 2>&1 | sed 's/^([0-9]*) //' | tr '\n' ' ')
+actual=${actual% }
+expected="terminated by signal 24 (CPU limit) 152"
+if [[ "$actual" != "$expected" ]]; then
+    echo "ulimit_test: FAIL, expected '$expected' but got '$actual'"
+    exit 1
+fi
+echo "ulimit_test: PASS"
@@ -0,0 +1,360 @@
+#include "./timers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "./fds.h"
+
+// a deadline of a job, in nanoseconds on the monotonic clock
+typedef struct timer {
+    long long deadline;
+    pid_t pid;
+    pid_t target;
+    int sig;
+    long long grace;
+} job_timer_t;
+
+// timers is a binary min heap on the deadlines, so the earliest is first
+// fired holds the PIDs of the jobs sent their timeout signal that have not
+// been reaped yet
+// reported is set once a failure to arm the timerfd has been reported
+struct timer_heap {
+    int fd;
+    int reported;
+    job_timer_t *timers;
+    int count;
+    int capacity;
+    pid_t *fired;
+    int fired_count;
+    int fired_capacity;
+};
+
+/* returns the time on the monotonic clock in nanoseconds */
+static long long now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (long long)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/*
+ * initializes an empty heap of job deadlines, returns pointer, or NULL if the
+ * timerfd could not be created
+ */
+timer_heap_t *init_timer_heap() {
+    timer_heap_t *timer_heap = (timer_heap_t *)malloc(sizeof(timer_heap_t));
+    if (timer_heap == NULL) {
+        return NULL;
+    }
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    // The timerfd lives as long as the shell, so it is moved out of the way
+    // of the low descriptors scripts redirect with exec
+    timer_heap->fd = fd == -1 ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, MIN_SHELL_FD);
+    if (fd != -1) {
+        close(fd);
+    }
+    if (timer_heap->fd == -1) {
+        free(timer_heap);
+        return NULL;
+    }
+    timer_heap->reported = 0;
+    timer_heap->timers = NULL;
+    timer_heap->count = 0;
+    timer_heap->capacity = 0;
+    timer_heap->fired = NULL;
+    timer_heap->fired_count = 0;
+    timer_heap->fired_capacity = 0;
+    return timer_heap;
+}
+
+/*
+ * cleans up the heap and closes its timerfd, without disarming it
+ * Note: this function will free the timer_heap pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_timer_heap(timer_heap_t *timer_heap) {
+    if (timer_heap == NULL) {
+        return;
+    }
+    close(timer_heap->fd);
+    free(timer_heap->timers);
+    free(timer_heap->fired);
+    free(timer_heap);
+}
+
+/* returns the timerfd to poll for the earliest deadline */
+int timer_fd(timer_heap_t *timer_heap) {
+    return timer_heap != NULL ? timer_heap->fd : -1;
+}
+
+/* returns 1 if any deadline is still pending, 0 otherwise */
+int has_timers(timer_heap_t *timer_heap) {
+    return timer_heap != NULL && timer_heap->count > 0;
+}
+
+/*
+ * arms the timerfd for the earliest deadline, or disarms it if none is left,
+ * returns 0 on success, -1 on failure
+ */
+static int arm(timer_heap_t *timer_heap) {
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when));
+    if (timer_heap->count > 0) {
+        long long deadline = timer_heap->timers[0].deadline;
+        when.it_value.tv_sec = (time_t)(deadline / 1000000000LL);
+        when.it_value.tv_nsec = (long)(deadline % 1000000000LL);
+        // A zero it_value disarms the timer instead
+        if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0) {
+            when.it_value.tv_nsec = 1;
+        }
+    }
+    return timerfd_settime(timer_heap->fd, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+/*
+ * arms the timerfd after deadlines were sent or removed, reporting a failure
+ * only the first time, as the next try is likely to fail just the same
+ */
+static void rearm(timer_heap_t *timer_heap) {
+    if (arm(timer_heap) == -1 && !timer_heap->reported) {
+        perror("timerfd_settime");
+        timer_heap->reported = 1;
+    }
+}
+
+/* swaps two timers in the heap */
+static void swap(job_timer_t *timers, int i, int j) {
+    job_timer_t timer = timers[i];
+    timers[i] = timers[j];
+    timers[j] = timer;
+}
+
+/* moves the timer at index up the heap to where its deadline belongs */
+static void sift_up(job_timer_t *timers, int index) {
+    while (index > 0 &&
+           timers[(index - 1) / 2].deadline > timers[index].deadline) {
+        swap(timers, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
+
+/* moves the timer at index down the heap to where its deadline belongs */
+static void sift_down(job_timer_t *timers, int count, int index) {
+    while (1) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < count && timers[left].deadline < timers[smallest].deadline) {
+            smallest = left;
+        }
+        if (right < count &&
+            timers[right].deadline < timers[smallest].deadline) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            return;
+        }
+        swap(timers, index, smallest);
+        index = smallest;
+    }
+}
+
+/* adds a timer to the heap, returns 0 on success, -1 on failure */
+static int push(timer_heap_t *timer_heap, job_timer_t timer) {
+    if (timer_heap->count == timer_heap->capacity) {
+        int capacity = 2 * timer_heap->capacity + 8;
+        job_timer_t *grown = (job_timer_t *)realloc(
+            timer_heap->timers, sizeof(job_timer_t) * (size_t)capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        timer_heap->timers = grown;
+        timer_heap->capacity = capacity;
+    }
+    timer_heap->timers[timer_heap->count] = timer;
+    sift_up(timer_heap->timers, timer_heap->count++);
+    return 0;
+}
+
+/* removes the timer at index from the heap */
+static void remove_at(timer_heap_t *timer_heap, int index) {
+    job_timer_t *timers = timer_heap->timers;
+    timers[index] = timers[--timer_heap->count];
+    if (index < timer_heap->count) {
+        sift_up(timers, index);
+        sift_down(timers, timer_heap->count, index);
+    }
+}
+
+/* adds a deadline for the job with the given PID, returns 0 or -1 */
+int add_timer(timer_heap_t *timer_heap, pid_t pid, pid_t target,
+              long long delay, int sig, long long grace) {
+    if (timer_heap == NULL) {
+        return -1;
+    }
+    job_timer_t timer = {now() + delay, pid, target, sig, grace};
+    if (push(timer_heap, timer) == -1) {
+        return -1;
+    }
+    if (arm(timer_heap) == -1) {
+        // A deadline that cannot come is taken back out
+        int error = errno;
+        cancel_timers(timer_heap, pid);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/* remembers that a job has been sent its timeout signal */
+static void mark_fired(timer_heap_t *timer_heap, pid_t pid) {
+    for (int i = 0; i < timer_heap->fired_count; i++) {
+        if (timer_heap->fired[i] == pid) {
+            return;
+        }
+    }
+    if (timer_heap->fired_count == timer_heap->fired_capacity) {
+        int capacity = 2 * timer_heap->fired_capacity + 8;
+        pid_t *grown = (pid_t *)realloc(timer_heap->fired,
+                                        sizeof(pid_t) * (size_t)capacity);
+        if (grown == NULL) {
+            return;
+        }
+        timer_heap->fired = grown;
+        timer_heap->fired_capacity = capacity;
+    }
+    timer_heap->fired[timer_heap->fired_count++] = pid;
+}
+
+/*
+ * sends the signals of every deadline that is due and rearms the timerfd
+ * for the next one
+ */
+void expire_timers(timer_heap_t *timer_heap) {
+    if (timer_heap == NULL) {
+        return;
+    }
+    // Empty the expiration count, so the timerfd stops polling readable
+    unsigned long long expirations;
+    while (read(timer_heap->fd, &expirations, sizeof(expirations)) > 0) {
+    }
+    if (timer_heap->count == 0) {
+        return;
+    }
+
+    long long current = now();
+    while (timer_heap->count > 0 &&
+           timer_heap->timers[0].deadline <= current) {
+        job_timer_t timer = timer_heap->timers[0];
+        remove_at(timer_heap, 0);
+        // The job may have exited without being reaped yet, which is fine
+        if (kill(timer.target, timer.sig) == -1 && errno != ESRCH) {
+            perror("kill");
+        }
+        if (timer.sig != SIGKILL && kill(timer.target, SIGCONT) == -1 &&
+            errno != ESRCH) {
+            perror("kill");
+        }
+        mark_fired(timer_heap, timer.pid);
+        if (timer.grace > 0) {
+            job_timer_t escalation = {current + timer.grace, timer.pid,
+                                      timer.target, SIGKILL, 0};
+            push(timer_heap, escalation);
+        }
+    }
+    rearm(timer_heap);
+}
+
+/*
+ * removes the deadlines of a job once it has been reaped, given its PID,
+ * returns 1 if the job was sent its timeout signal, 0 otherwise
+ */
+int cancel_timers(timer_heap_t *timer_heap, pid_t pid) {
+    if (timer_heap == NULL) {
+        return 0;
+    }
+    int removed = 0;
+    for (int i = 0; i < timer_heap->count; i++) {
+        if (timer_heap->timers[i].pid == pid) {
+            remove_at(timer_heap, i);
+            // Look at whatever was moved into this index as well
+            i = -1;
+            removed = 1;
+        }
+    }
+    if (removed) {
+        rearm(timer_heap);
+    }
+    for (int i = 0; i < timer_heap->fired_count; i++) {
+        if (timer_heap->fired[i] == pid) {
+            timer_heap->fired[i] = timer_heap->fired[--timer_heap->fired_count];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * parses a duration such as 10, 0.5, 90s, 2m, 1h or 1d into nanoseconds,
+ * returns 0 on success, -1 if text is not a duration
+ */
+int parse_duration(const char *text, long long *duration) {
+    char *end;
+    errno = 0;
+    double seconds = strtod(text, &end);
+    if (end == text || errno != 0 || !isfinite(seconds) || seconds < 0) {
+        return -1;
+    }
+    switch (*end) {
+        case '\0':
+        case 's':
+            break;
+        case 'm':
+            seconds *= 60;
+            break;
+        case 'h':
+            seconds *= 60 * 60;
+            break;
+        case 'd':
+            seconds *= 24 * 60 * 60;
+            break;
+        default:
+            return -1;
+    }
+    if (*end != '\0' && end[1] != '\0') {
+        return -1;
+    }
+    // A century is as good as forever
+    if (seconds > 100.0 * 365 * 24 * 60 * 60) {
+        seconds = 100.0 * 365 * 24 * 60 * 60;
+    }
+    *duration = (long long)(seconds * 1e9);
+    return 0;
+}
+
+/*
+ * parses a signal given by number or by name, with or without its SIG
+ * prefix, returns the signal number, or -1 if text is not a signal
+ */
+int parse_signal(const char *text) {
+    char *end;
+    long number = strtol(text, &end, 10);
+    if (end != text && *end == '\0') {
+        return number > 0 && number < NSIG ? (int)number : -1;
+    }
+    if (strncmp(text, "SIG", 3) == 0) {
+        text += 3;
+    }
+    for (int sig = 1; sig < NSIG; sig++) {
+        const char *name = sigabbrev_np(sig);
+        if (name != NULL && strcmp(name, text) == 0) {
+            return sig;
+        }
+    }
+    return -1;
+}
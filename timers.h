@@ -0,0 +1,58 @@
+#ifndef TIMERS_H_
+#define TIMERS_H_
+
+#include <sys/types.h>
+
+typedef struct timer_heap timer_heap_t;
+
+/*
+ * initializes an empty heap of job deadlines, along with the timerfd that
+ * becomes readable when the earliest one is due, which is kept at descriptor
+ * 10 or above, returns pointer, or NULL if the timerfd could not be created
+ */
+timer_heap_t *init_timer_heap();
+/*
+ * cleans up the heap and closes its timerfd, without disarming it, so a
+ * child can replace the heap it inherited without touching its parent's
+ * Note: this function will free the timer_heap pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_timer_heap(timer_heap_t *timer_heap);
+
+/* returns the timerfd to poll for the earliest deadline */
+int timer_fd(timer_heap_t *timer_heap);
+/* returns 1 if any deadline is still pending, 0 otherwise */
+int has_timers(timer_heap_t *timer_heap);
+
+/*
+ * adds a deadline delay nanoseconds from now for the job with the given PID,
+ * at which sig is sent to target, which kill takes as it is, followed by
+ * SIGCONT so a stopped job gets it too. If the job is still around grace
+ * nanoseconds later it is sent SIGKILL, unless grace is 0.
+ * returns 0 on success, -1 on failure, with errno set and no deadline added
+ */
+int add_timer(timer_heap_t *timer_heap, pid_t pid, pid_t target,
+              long long delay, int sig, long long grace);
+/*
+ * sends the signals of every deadline that is due and rearms the timerfd
+ * for the next one, call this whenever the timerfd is readable
+ */
+void expire_timers(timer_heap_t *timer_heap);
+/*
+ * removes the deadlines of a job once it has been reaped, given its PID,
+ * returns 1 if the job was sent its timeout signal, 0 otherwise
+ */
+int cancel_timers(timer_heap_t *timer_heap, pid_t pid);
+
+/*
+ * parses a duration such as 10, 0.5, 90s, 2m, 1h or 1d into nanoseconds,
+ * returns 0 on success, -1 if text is not a duration
+ */
+int parse_duration(const char *text, long long *duration);
+/*
+ * parses a signal given by number or by name, with or without its SIG
+ * prefix, returns the signal number, or -1 if text is not a signal
+ */
+int parse_signal(const char *text);
+
+#endif  // TIMERS_H_
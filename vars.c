@@ -0,0 +1,374 @@
+#include "./vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct var_element {
+    char *name;
+    // NULL while the variable is exported but has not been given a value
+    char *value;
+    int exported;
+    // index of this variable's NAME=value entry in envp, -1 if it has none
+    int env_index;
+    struct var_element *next;
+};
+typedef struct var_element var_element_t;
+
+// buckets is a hash table of variables chained through next
+// envp holds the NAME=value strings of exported variables, NULL terminated,
+// and env_owner holds the variable each of those strings belongs to
+struct var_table {
+    var_element_t **buckets;
+    size_t bucket_count;
+    size_t var_count;
+    char **envp;
+    var_element_t **env_owner;
+    size_t env_count;
+    size_t env_capacity;
+};
+
+#define INITIAL_BUCKETS 64
+#define INITIAL_ENV_CAPACITY 32
+
+/* hashes a variable name of the given length with FNV-1a */
+static size_t hash_name(const char *name, size_t length) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* finds a variable given its name, returns NULL if it does not exist */
+static var_element_t *find_var(var_table_t *var_table, const char *name) {
+    size_t length = strlen(name);
+    size_t bucket = hash_name(name, length) % var_table->bucket_count;
+    var_element_t *cur = var_table->buckets[bucket];
+    while (cur != NULL) {
+        if (strcmp(cur->name, name) == 0) {
+            return cur;
+        }
+        cur = cur->next;
+    }
+    return NULL;
+}
+
+/* doubles the number of buckets once the table is three quarters full */
+static void grow_buckets(var_table_t *var_table) {
+    size_t new_count = var_table->bucket_count * 2;
+    var_element_t **new_buckets =
+        (var_element_t **)calloc(new_count, sizeof(var_element_t *));
+    if (new_buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < var_table->bucket_count; i++) {
+        var_element_t *cur = var_table->buckets[i];
+        while (cur != NULL) {
+            var_element_t *next = cur->next;
+            size_t bucket =
+                hash_name(cur->name, strlen(cur->name)) % new_count;
+            cur->next = new_buckets[bucket];
+            new_buckets[bucket] = cur;
+            cur = next;
+        }
+    }
+    free(var_table->buckets);
+    var_table->buckets = new_buckets;
+    var_table->bucket_count = new_count;
+}
+
+/* removes a variable's entry from envp by moving the last entry into its slot */
+static void env_remove(var_table_t *var_table, var_element_t *var) {
+    if (var->env_index < 0) {
+        return;
+    }
+    size_t index = (size_t)var->env_index;
+    size_t last = var_table->env_count - 1;
+    free(var_table->envp[index]);
+    if (index != last) {
+        var_table->envp[index] = var_table->envp[last];
+        var_table->env_owner[index] = var_table->env_owner[last];
+        var_table->env_owner[index]->env_index = (int)index;
+    }
+    var_table->envp[last] = NULL;
+    var_table->env_owner[last] = NULL;
+    var_table->env_count = last;
+    var->env_index = -1;
+}
+
+/*
+ * writes a variable's NAME=value entry into envp, replacing only its own slot
+ * returns 0 on success, -1 on failure
+ */
+static int env_update(var_table_t *var_table, var_element_t *var) {
+    size_t name_length = strlen(var->name);
+    size_t value_length = strlen(var->value);
+    char *entry = (char *)malloc(name_length + value_length + 2);
+    if (entry == NULL) {
+        return -1;
+    }
+    memcpy(entry, var->name, name_length);
+    entry[name_length] = '=';
+    memcpy(entry + name_length + 1, var->value, value_length + 1);
+
+    if (var->env_index >= 0) {
+        free(var_table->envp[var->env_index]);
+        var_table->envp[var->env_index] = entry;
+        return 0;
+    }
+    // Leave room for the terminating NULL
+    if (var_table->env_count + 1 >= var_table->env_capacity) {
+        size_t new_capacity = var_table->env_capacity * 2;
+        char **new_envp =
+            (char **)realloc(var_table->envp, new_capacity * sizeof(char *));
+        if (new_envp == NULL) {
+            free(entry);
+            return -1;
+        }
+        var_table->envp = new_envp;
+        var_element_t **new_owner = (var_element_t **)realloc(
+            var_table->env_owner, new_capacity * sizeof(var_element_t *));
+        if (new_owner == NULL) {
+            free(entry);
+            return -1;
+        }
+        var_table->env_owner = new_owner;
+        var_table->env_capacity = new_capacity;
+    }
+    var->env_index = (int)var_table->env_count;
+    var_table->envp[var_table->env_count] = entry;
+    var_table->env_owner[var_table->env_count] = var;
+    var_table->env_count++;
+    var_table->envp[var_table->env_count] = NULL;
+    return 0;
+}
+
+/* creates an unset variable with the given name, returns NULL on failure */
+static var_element_t *create_var(var_table_t *var_table, const char *name) {
+    if (var_table->var_count * 4 >= var_table->bucket_count * 3) {
+        grow_buckets(var_table);
+    }
+    var_element_t *new = (var_element_t *)malloc(sizeof(var_element_t));
+    if (new == NULL) {
+        return NULL;
+    }
+    new->name = strdup(name);
+    if (new->name == NULL) {
+        free(new);
+        return NULL;
+    }
+    new->value = NULL;
+    new->exported = 0;
+    new->env_index = -1;
+    size_t bucket =
+        hash_name(name, strlen(name)) % var_table->bucket_count;
+    new->next = var_table->buckets[bucket];
+    var_table->buckets[bucket] = new;
+    var_table->var_count++;
+    return new;
+}
+
+/*
+ * initializes the variable table, importing every NAME=value entry of envp
+ * as an exported variable, returns pointer
+ */
+var_table_t *init_var_table(char **envp) {
+    var_table_t *var_table = (var_table_t *)malloc(sizeof(var_table_t));
+    var_table->bucket_count = INITIAL_BUCKETS;
+    var_table->buckets =
+        (var_element_t **)calloc(INITIAL_BUCKETS, sizeof(var_element_t *));
+    var_table->var_count = 0;
+    var_table->env_capacity = INITIAL_ENV_CAPACITY;
+    var_table->envp = (char **)calloc(INITIAL_ENV_CAPACITY, sizeof(char *));
+    var_table->env_owner = (var_element_t **)calloc(INITIAL_ENV_CAPACITY,
+                                                    sizeof(var_element_t *));
+    var_table->env_count = 0;
+
+    for (size_t i = 0; envp != NULL && envp[i] != NULL; i++) {
+        char *equals = strchr(envp[i], '=');
+        if (equals == NULL || !is_var_name(envp[i], (size_t)(equals - envp[i]))) {
+            continue;
+        }
+        char *name = strndup(envp[i], (size_t)(equals - envp[i]));
+        if (name == NULL) {
+            continue;
+        }
+        set_var(var_table, name, equals + 1, 1);
+        free(name);
+    }
+    return var_table;
+}
+
+/*
+ * cleans up the variable table
+ * Note: this function will free the var_table pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_var_table(var_table_t *var_table) {
+    if (var_table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < var_table->bucket_count; i++) {
+        var_element_t *cur = var_table->buckets[i];
+        while (cur != NULL) {
+            var_element_t *next = cur->next;
+            free(cur->name);
+            free(cur->value);
+            free(cur);
+            cur = next;
+        }
+    }
+    for (size_t i = 0; i < var_table->env_count; i++) {
+        free(var_table->envp[i]);
+    }
+    free(var_table->buckets);
+    free(var_table->envp);
+    free(var_table->env_owner);
+    free(var_table);
+}
+
+/* returns 1 if name is a valid variable name, 0 otherwise */
+int is_var_name(const char *name, size_t length) {
+    if (length == 0 || !(name[0] == '_' || (name[0] >= 'a' && name[0] <= 'z') ||
+                         (name[0] >= 'A' && name[0] <= 'Z'))) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* returns the length of the variable name at the start of text, 0 if none */
+size_t var_name_length(const char *text) {
+    if (!is_var_name(text, 1)) {
+        return 0;
+    }
+    size_t length = 1;
+    char c;
+    while ((c = text[length]) == '_' || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        length++;
+    }
+    return length;
+}
+
+/* gets the value of a variable, returns NULL if it is unset */
+char *get_var(var_table_t *var_table, const char *name) {
+    if (var_table == NULL) {
+        return NULL;
+    }
+    var_element_t *var = find_var(var_table, name);
+    return var == NULL ? NULL : var->value;
+}
+
+/*
+ * sets a variable, keeping its exported flag, and exports it as well if
+ * export is nonzero, returns 0 on success, -1 on failure
+ */
+int set_var(var_table_t *var_table, const char *name, const char *value,
+            int export) {
+    if (var_table == NULL || name == NULL || value == NULL) {
+        return -1;
+    }
+    var_element_t *var = find_var(var_table, name);
+    if (var == NULL && (var = create_var(var_table, name)) == NULL) {
+        return -1;
+    }
+    char *copy = strdup(value);
+    if (copy == NULL) {
+        return -1;
+    }
+    free(var->value);
+    var->value = copy;
+    if (export) {
+        var->exported = 1;
+    }
+    // Only an exported variable touches envp, and only its own slot
+    if (var->exported) {
+        return env_update(var_table, var);
+    }
+    return 0;
+}
+
+/*
+ * marks a variable as exported, a variable that is still unset is only
+ * placed into the environment once it is given a value,
+ * returns 0 on success, -1 on failure
+ */
+int export_var(var_table_t *var_table, const char *name) {
+    if (var_table == NULL) {
+        return -1;
+    }
+    var_element_t *var = find_var(var_table, name);
+    if (var == NULL && (var = create_var(var_table, name)) == NULL) {
+        return -1;
+    }
+    if (var->exported) {
+        return 0;
+    }
+    var->exported = 1;
+    if (var->value != NULL) {
+        return env_update(var_table, var);
+    }
+    return 0;
+}
+
+/* removes a variable, returns 0 on success, -1 on failure */
+int unset_var(var_table_t *var_table, const char *name) {
+    if (var_table == NULL) {
+        return -1;
+    }
+    size_t bucket = hash_name(name, strlen(name)) % var_table->bucket_count;
+    var_element_t *prev = NULL;
+    var_element_t *cur = var_table->buckets[bucket];
+    while (cur != NULL) {
+        if (strcmp(cur->name, name) == 0) {
+            if (prev != NULL) {
+                prev->next = cur->next;
+            } else {
+                var_table->buckets[bucket] = cur->next;
+            }
+            env_remove(var_table, cur);
+            free(cur->name);
+            free(cur->value);
+            free(cur);
+            var_table->var_count--;
+            return 0;
+        }
+        prev = cur;
+        cur = cur->next;
+    }
+    // Unsetting a variable that does not exist is not an error
+    return 0;
+}
+
+/*
+ * gets the NULL terminated environment built from the exported variables
+ * the array is updated in place whenever an exported variable changes, so it
+ * can be handed to execve without being rebuilt for every command
+ */
+char **get_envp(var_table_t *var_table) {
+    if (var_table == NULL) {
+        return NULL;
+    }
+    return var_table->envp;
+}
+
+/* export command, prints out every exported variable */
+void print_exports(var_table_t *var_table) {
+    if (var_table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < var_table->env_count; i++) {
+        if (printf("export %s\n", var_table->envp[i]) < 0) {
+            fprintf(stderr, "error printing exported variables\n");
+            return;
+        }
+    }
+}
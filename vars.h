@@ -0,0 +1,52 @@
+#ifndef VARS_H_
+#define VARS_H_
+
+#include <stddef.h>
+
+typedef struct var_table var_table_t;
+
+/*
+ * initializes the variable table, importing every NAME=value entry of envp
+ * as an exported variable, returns pointer
+ */
+var_table_t *init_var_table(char **envp);
+/*
+ * cleans up the variable table
+ * Note: this function will free the var_table pointer
+ * DO NOT use the pointer after this function is called
+ */
+void cleanup_var_table(var_table_t *var_table);
+
+/* returns 1 if name is a valid variable name, 0 otherwise */
+int is_var_name(const char *name, size_t length);
+/* returns the length of the variable name at the start of text, 0 if none */
+size_t var_name_length(const char *text);
+
+/* gets the value of a variable, returns NULL if it is unset */
+char *get_var(var_table_t *var_table, const char *name);
+/*
+ * sets a variable, keeping its exported flag, and exports it as well if
+ * export is nonzero, returns 0 on success, -1 on failure
+ */
+int set_var(var_table_t *var_table, const char *name, const char *value,
+            int export);
+/*
+ * marks a variable as exported, a variable that is still unset is only
+ * placed into the environment once it is given a value,
+ * returns 0 on success, -1 on failure
+ */
+int export_var(var_table_t *var_table, const char *name);
+/* removes a variable, returns 0 on success, -1 on failure */
+int unset_var(var_table_t *var_table, const char *name);
+
+/*
+ * gets the NULL terminated environment built from the exported variables
+ * the array is updated in place whenever an exported variable changes, so it
+ * can be handed to execve without being rebuilt for every command
+ */
+char **get_envp(var_table_t *var_table);
+
+/* export command, prints out every exported variable */
+void print_exports(var_table_t *var_table);
+
+#endif  // VARS_H_